@@ -0,0 +1,78 @@
+/**
+ * @file bench.h
+ * @brief Tiny microbenchmark harness. Each benchmark is a callable doing a fixed number of ops per call,
+ * which is run until it has taken min_seconds, after one untimed warm up call.
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bench{
+
+struct Result{
+    std::string name;
+    uint64_t ops; // total timed ops
+    double seconds; // total timed wall clock time
+    double ns_per_op;
+};
+
+/// @brief Keeps the compiler from optimizing away the computation of value.
+template <typename T>
+inline void do_not_optimize(const T& value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// @brief Times call() (which does ops_per_call ops) until min_seconds have passed.
+template <typename Call>
+Result run(const std::string& name, uint64_t ops_per_call, double min_seconds, Call&& call){
+    using clock = std::chrono::steady_clock;
+    call();
+
+    uint64_t calls = 0;
+    clock::time_point start = clock::now();
+    double seconds = 0.0;
+    do {
+        call();
+        ++calls;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (seconds < min_seconds);
+
+    uint64_t ops = calls * ops_per_call;
+    return {name, ops, seconds, seconds * 1e9 / static_cast<double>(ops)};
+}
+
+inline void print_results(const std::vector<Result>& results){
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14) << "ns/op"
+        << std::setw(14) << "ops" << '\n';
+    for (const Result& r : results){
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << r.ns_per_op << std::setw(14) << r.ops << '\n';
+    }
+}
+
+/// @brief Writes {"benchmarks": [{"name", "ns_per_op", "ops", "seconds"}, ...]} to path.
+/// Names are written as is, so they must not need escaping.
+inline void write_json(const std::string& path, const std::vector<Result>& results){
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("cannot open " + path);
+
+    out << "{\n  \"benchmarks\": [\n" << std::setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i){
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.ns_per_op
+            << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+
+    if (!out) throw std::runtime_error("write failed: " + path);
+}
+
+}
@@ -0,0 +1,36 @@
+/**
+ * @file fixtures.h
+ * @brief Inputs shared by the benchmarks that do not need any clustering output.
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "card_buckets.h"
+#include "indexer.h"
+
+namespace bench{
+
+/// @brief CardBuckets with num_clusters flop/turn/river clusters assigned by hand index (hand i is in cluster
+/// i % num_clusters), and one cluster per preflop hand like the real buckets.
+/// @note The tables are still indexed by hand, so the river table alone is ~500MB.
+inline CardBuckets synthetic_buckets(size_t num_clusters){
+    CardBuckets buckets;
+    buckets.preflop_clusters.resize(169);
+    for (size_t i = 0; i < 169; ++i) buckets.preflop_clusters[i] = static_cast<int>(i);
+
+    std::array<HugeVector<int>*, 3> tables = {&buckets.flop_clusters, &buckets.turn_clusters, &buckets.river_clusters};
+    for (size_t street = 1; street <= 3; ++street){
+        std::array<uint8_t, 2> cpr = {2, static_cast<uint8_t>(street + 2)};
+        Indexer indexer(cpr.size(), cpr.data());
+        HugeVector<int>& table = *tables[street - 1];
+        table.resize(hand_indexer_size(&indexer.h, 1));
+        for (size_t i = 0; i < table.size(); ++i) table[i] = static_cast<int>(i % num_clusters);
+    }
+
+    buckets.cluster_counts = {169, num_clusters, num_clusters, num_clusters};
+    return buckets;
+}
+
+}
@@ -0,0 +1,249 @@
+#include <array>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "fixtures.h"
+#include "evaluator.h"
+#include "indexer.h"
+#include "dealer.h"
+#include "info_sets.h"
+#include "action_tree.h"
+#include "cfr.h"
+#include "training.h"
+#include "emd_k_means.h"
+#include "L1_k_means.h"
+
+namespace fs = std::filesystem;
+
+/**
+ * Microbenchmarks for the solver and clustering hot paths. Inputs are generated up front from fixed seeds,
+ * so the timed loops only run the function being measured.
+ * usage: bench [--filter <substring>] [--min-time <seconds>] [--json <path>]
+ */
+
+struct BenchOptions{
+    std::string filter;
+    double min_seconds = 0.5;
+    std::string json_path;
+};
+
+static constexpr uint32_t seed = 0;
+static constexpr size_t batch = 4096; // inputs per timed call
+
+/// @brief batch deals from a fixed seed
+static std::vector<Dealer> make_deals(){
+    std::mt19937 rng(seed);
+    std::vector<Dealer> deals(batch);
+    for (Dealer& d : deals) d.deal(rng);
+    return deals;
+}
+
+static void bench_evaluator(const BenchOptions& opts, std::vector<bench::Result>& results){
+    std::vector<Dealer> deals = make_deals();
+    std::vector<std::array<uint8_t, 7>> ranks(batch), suits(batch);
+    for (size_t i = 0; i < batch; ++i){
+        for (size_t c = 0; c < 7; ++c){
+            ranks[i][c] = card_rank(deals[i].cards[0][c]);
+            suits[i][c] = card_suit(deals[i].cards[0][c]);
+        }
+    }
+
+    results.push_back(bench::run("evaluate_raw", batch, opts.min_seconds, [&]{
+        for (size_t i = 0; i < batch; ++i) bench::do_not_optimize(evaluate_raw(ranks[i].data(), suits[i].data(), 7));
+    }));
+}
+
+static void bench_dealer(const BenchOptions& opts, std::vector<bench::Result>& results){
+    std::mt19937 rng(seed);
+    Dealer dealer;
+    results.push_back(bench::run("Dealer::deal", batch, opts.min_seconds, [&]{
+        for (size_t i = 0; i < batch; ++i){
+            dealer.deal(rng);
+            bench::do_not_optimize(dealer.winner);
+        }
+    }));
+}
+
+static void bench_indexer(const BenchOptions& opts, std::vector<bench::Result>& results){
+    std::vector<Dealer> deals = make_deals();
+    const std::array<std::string, 4> streets = {"preflop", "flop", "turn", "river"};
+
+    for (size_t street = 0; street < streets.size(); ++street){
+        std::vector<uint8_t> cpr = {2};
+        if (street > 0) cpr.push_back(static_cast<uint8_t>(street + 2));
+        Indexer indexer(cpr.size(), cpr.data());
+
+        results.push_back(bench::run("hand_index_last/" + streets[street], batch, opts.min_seconds, [&]{
+            for (size_t i = 0; i < batch; ++i) bench::do_not_optimize(hand_index_last(&indexer.h, deals[i].cards[0].data()));
+        }));
+    }
+}
+
+static void bench_infosets(const BenchOptions& opts, const CFRSpec& spec, std::vector<bench::Result>& results){
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
+    ActionTree action_tree{init_state, spec.bet_sizes};
+
+    results.push_back(bench::run("ActionTree::ActionTree", 1, opts.min_seconds, [&]{
+        ActionTree built{init_state, spec.bet_sizes};
+        bench::do_not_optimize(built.nodes.data());
+    }));
+    const std::vector<size_t> cluster_counts = {169, 50, 50, 50};
+    InfoSets isets(action_tree, cluster_counts);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> regret(-1.0, 1.0);
+    for (double& r : isets.regret_sum) r = regret(rng);
+
+    std::vector<size_t> decision_nodes;
+    for (size_t node = 0; node < action_tree.nodes.size(); ++node)
+        if (!action_tree.is_terminal(node)) decision_nodes.push_back(node);
+
+    // random decision nodes and clusters, like the keys a traversal visits
+    std::vector<InfoKey> keys(batch);
+    for (InfoKey& key : keys){
+        size_t node = decision_nodes[rng() % decision_nodes.size()];
+        size_t street = static_cast<size_t>(action_tree.street(node));
+        key = {static_cast<NodeIdx>(node), static_cast<ClusterIdx>(rng() % cluster_counts[street]),
+            static_cast<ActionCount>(action_tree.num_children(node))};
+    }
+
+    std::vector<double> strategy;
+    results.push_back(bench::run("InfoSets::get_regret_strategy", batch, opts.min_seconds, [&]{
+        for (const InfoKey& key : keys){
+            isets.get_regret_strategy(key, strategy);
+            bench::do_not_optimize(strategy.data());
+        }
+    }));
+
+    std::vector<std::vector<double>> deltas(action_tree.max_branching() + 1);
+    for (size_t n = 0; n < deltas.size(); ++n) deltas[n].assign(n, 1e-3);
+    results.push_back(bench::run("InfoSets::update_regret", batch, opts.min_seconds, [&]{
+        for (const InfoKey& key : keys) isets.update_regret(key, deltas[key.num_actions]);
+        bench::do_not_optimize(isets.regret_sum.data());
+    }));
+
+    int t = isets.last_discount_iter;
+    results.push_back(bench::run("InfoSets::discount", 1, opts.min_seconds, [&]{
+        isets.discount(++t);
+        bench::do_not_optimize(isets.regret_sum.data());
+    }));
+}
+
+static void bench_distances(const BenchOptions& opts, std::vector<bench::Result>& results){
+    std::mt19937 rng(seed);
+
+    // flop clustering shapes: histograms of 47 turn cards over 50 turn clusters
+    const size_t num_verts = 50, multiset_size = 47;
+    emd::Params params{
+        .num_clusters = 1,
+        .num_verts = num_verts,
+        .center_support = multiset_size,
+        .multiset_size = multiset_size,
+        .num_multisets = batch,
+        .weight_matrix = std::vector<float>(num_verts * num_verts),
+        .max_iters = 0,
+        .rng = std::mt19937{seed}
+    };
+    for (size_t i = 0; i < num_verts; ++i)
+        for (size_t j = 0; j < num_verts; ++j)
+            params.weight_matrix[i * num_verts + j] = static_cast<float>(i > j ? i - j : j - i);
+
+    std::vector<uint8_t> histograms(batch * num_verts, 0);
+    for (size_t m = 0; m < batch; ++m)
+        for (size_t draw = 0; draw < multiset_size; ++draw) ++histograms[m * num_verts + rng() % num_verts];
+
+    std::vector<emd::SparseMultiset> sparse(batch);
+    for (size_t m = 0; m < batch; ++m)
+        emd::fill_sparse_multiset(params, std::span<const uint8_t>(histograms).subspan(m * num_verts, num_verts), sparse[m]);
+
+    std::vector<int> dense(num_verts, 0);
+    emd::add_to_dense(params, std::span<const uint8_t>(histograms).first(num_verts), dense);
+    emd::Center center;
+    emd::clipped_dense_center(params, center, dense);
+    emd::EMDCache cache;
+    emd::fill_emd_cache(params, center, cache);
+
+    results.push_back(bench::run("approx_EMD", batch, opts.min_seconds, [&]{
+        for (const emd::SparseMultiset& m : sparse) bench::do_not_optimize(emd::approx_EMD(params, center, m, cache));
+    }));
+
+    // turn clustering shapes: 20 bucket uint8 cdfs against int centers
+    const size_t dim = 20;
+    std::vector<uint8_t> cdfs(batch * dim);
+    for (uint8_t& c : cdfs) c = static_cast<uint8_t>(rng() % 47);
+    std::vector<int> l1_center(dim);
+    for (int& c : l1_center) c = static_cast<int>(rng() % 47);
+
+    results.push_back(bench::run("L1_dist", batch, opts.min_seconds, [&]{
+        for (size_t p = 0; p < batch; ++p){
+            std::span<const uint8_t> pt(cdfs.data() + p * dim, dim);
+            bench::do_not_optimize(L1::L1_dist(pt, std::span<const int>(l1_center)));
+        }
+    }));
+}
+
+static void bench_cfr(const BenchOptions& opts, const CFRSpec& spec, const TrainParams& train,
+    std::vector<bench::Result>& results){
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
+    CFR cfr{bench::synthetic_buckets(50), ActionTree{init_state, spec.bet_sizes}};
+
+    // one op = one deal plus a traversal for each player, on one thread.
+    // Each call ends with a discount, at the same cadence as in training.
+    const size_t iters = train.iters_per_discount;
+    uint32_t train_seed = seed;
+    results.push_back(bench::run("CFR::traverse", iters, opts.min_seconds, [&]{
+        cfr.train(iters, iters, 1, 1, train_seed++);
+    }));
+}
+
+static BenchOptions parse_args(int argc, char** argv){
+    BenchOptions opts;
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+        if (arg == "--filter") opts.filter = argv[++i];
+        else if (arg == "--min-time") opts.min_seconds = std::stod(argv[++i]);
+        else if (arg == "--json") opts.json_path = argv[++i];
+        else throw std::runtime_error("unknown argument " + arg + ", usage: bench [--filter s] [--min-time s] [--json path]");
+    }
+    return opts;
+}
+
+int main(int argc, char** argv) {
+    try {
+        fs::path exe  = fs::weakly_canonical(fs::path(argv[0]));
+        fs::path root = exe.parent_path().parent_path();
+
+        BenchOptions opts = parse_args(argc, argv);
+        CFRSpec spec = load_cfr_config(root / "configs/cfr.toml", root);
+        TrainParams train = load_train_config(root / "configs/train.toml", root);
+        auto selected = [&](const std::string& group){ return group.find(opts.filter) != std::string::npos; };
+
+        // group names list the benchmarks in them, so --filter matches either
+        std::vector<bench::Result> results;
+        if (selected("evaluate_raw")) bench_evaluator(opts, results);
+        if (selected("Dealer::deal")) bench_dealer(opts, results);
+        if (selected("hand_index_last/preflop/flop/turn/river")) bench_indexer(opts, results);
+        if (selected("ActionTree::ActionTree/InfoSets::get_regret_strategy/update_regret/discount")) bench_infosets(opts, spec, results);
+        if (selected("approx_EMD/L1_dist")) bench_distances(opts, results);
+        if (selected("CFR::traverse")) bench_cfr(opts, spec, train, results);
+
+        bench::print_results(results);
+        if (!opts.json_path.empty()) bench::write_json(opts.json_path, results);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <omp.h>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "fixtures.h"
+#include "action_tree.h"
+#include "cfr.h"
+#include "poker_state.h"
+#include "training.h"
+
+/**
+ * End to end training throughput. Trains a fixed small abstraction (synthetic buckets and a fixed betting tree,
+ * so no data is needed) for a fixed number of iterations at 1, 2, 4, ..., max threads, and compares the results
+ * against a baseline written by an earlier --json run: bench/baselines/throughput.json unless --baseline names
+ * another file, or is "none". The baseline has to be recorded with the same iters and settings: otherwise the
+ * stored one is skipped and a named one is an error.
+ * usage: throughput [--iters n] [--max-threads n] [--json path] [--baseline path] [--tolerance frac]
+ *     [--affinity none|compact|spread] [--placement first_touch|interleave|partition] [--huge-pages off|thp|2mb|1gb]
+ *     [--scheduler for|tasks|epochs] [--task-depth n]
+ * These options are the scheduler, [numa] and [memory] settings of configs/train.toml, run once per setting
+ * to compare them.
+ * Exits with 2 if a thread count regressed by more than the tolerance.
+ */
+
+using steady = std::chrono::steady_clock;
+
+struct ThroughputOptions{
+    size_t iters = 100'000;
+    size_t max_threads = static_cast<size_t>(omp_get_max_threads());
+    std::string json_path;
+    std::string baseline_path; // empty for the stored baseline, "none" to skip the comparison
+    double tolerance = 0.1; // allowed relative drop in iters/sec and scaling efficiency
+    numa::NumaParams numa;
+    huge_pages::Mode huge_pages = huge_pages::Mode::off;
+    SchedulerParams scheduler;
+};
+
+struct ThroughputRun{
+    size_t threads;
+    double seconds;
+    double iters_per_sec;
+    double nodes_per_sec;
+    double efficiency; // iters_per_sec / (threads * single thread iters_per_sec)
+    double peak_rss_mb; // peak resident set of the whole process so far
+};
+
+// the fixed abstraction. Changing any of these invalidates stored baselines.
+static constexpr size_t num_clusters = 16;
+static constexpr size_t iters_per_discount = 10'000;
+static constexpr size_t omp_chunk_sz = 256;
+static constexpr uint32_t base_seed = 0;
+
+static ActionTree fixed_action_tree(){
+    Table table{200, 2, 1};
+    PokerState init_state{table};
+    return ActionTree{init_state, {{0.5, 1.0}, {0.33, 0.75}, {0.75}, {0.75}}};
+}
+
+static double peak_rss_mb(){
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<double>(usage.ru_maxrss) / (1024.0 * 1024.0); // bytes
+#else
+    return static_cast<double>(usage.ru_maxrss) / 1024.0; // kilobytes
+#endif
+}
+
+static std::vector<size_t> thread_counts(size_t max_threads){
+    std::vector<size_t> counts;
+    for (size_t t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+static ThroughputRun time_training(const ThroughputOptions& opts, size_t threads){
+    CFR cfr{bench::synthetic_buckets(num_clusters), fixed_action_tree()};
+    cfr.set_numa(opts.numa);
+    cfr.set_scheduler(opts.scheduler);
+    if (threads == 1) print_page_report(std::cout, cfr);
+
+    steady::time_point start = steady::now();
+    cfr.train(opts.iters, iters_per_discount, threads, omp_chunk_sz, base_seed);
+    double seconds = std::chrono::duration<double>(steady::now() - start).count();
+
+    return {
+        .threads = threads,
+        .seconds = seconds,
+        .iters_per_sec = static_cast<double>(opts.iters) / seconds,
+        .nodes_per_sec = static_cast<double>(cfr.get_nodes_visited()) / seconds,
+        .efficiency = 1.0,
+        .peak_rss_mb = peak_rss_mb()
+    };
+}
+
+static void print_runs(const std::vector<ThroughputRun>& runs){
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "seconds" << std::setw(14) << "iters/s"
+        << std::setw(16) << "nodes/s" << std::setw(12) << "efficiency" << std::setw(14) << "peak rss MB" << '\n';
+    for (const ThroughputRun& r : runs){
+        std::cout << std::fixed << std::setprecision(2) << std::setw(8) << r.threads << std::setw(12) << r.seconds
+            << std::setw(14) << r.iters_per_sec << std::setw(16) << r.nodes_per_sec
+            << std::setw(12) << r.efficiency << std::setw(14) << r.peak_rss_mb << '\n';
+    }
+}
+
+/// @brief Writes the runs one per line, which is the layout read_baseline expects.
+static void write_json(const std::string& path, const ThroughputOptions& opts, const std::vector<ThroughputRun>& runs){
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("cannot open " + path);
+
+    out << "{\n  \"iters\": " << opts.iters << ",\n  \"affinity\": \"" << numa::to_string(opts.numa.affinity)
+        << "\",\n  \"placement\": \"" << numa::to_string(opts.numa.placement)
+        << "\",\n  \"huge_pages\": \"" << huge_pages::to_string(opts.huge_pages)
+        << "\",\n  \"scheduler\": \"" << to_string(opts.scheduler.scheduler)
+        << "\",\n  \"task_depth\": " << opts.scheduler.task_depth << ",\n  \"runs\": [\n" << std::setprecision(6);
+    for (size_t i = 0; i < runs.size(); ++i){
+        const ThroughputRun& r = runs[i];
+        out << "    {\"threads\": " << r.threads << ", \"seconds\": " << r.seconds
+            << ", \"iters_per_sec\": " << r.iters_per_sec << ", \"nodes_per_sec\": " << r.nodes_per_sec
+            << ", \"efficiency\": " << r.efficiency << ", \"peak_rss_mb\": " << r.peak_rss_mb << "}"
+            << (i + 1 < runs.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+
+    if (!out) throw std::runtime_error("write failed: " + path);
+}
+
+static double json_number(const std::string& line, const std::string& key){
+    size_t at = line.find("\"" + key + "\":");
+    if (at == std::string::npos) throw std::runtime_error("baseline run is missing " + key + ": " + line);
+    return std::stod(line.substr(at + key.size() + 3));
+}
+
+using Settings = std::vector<std::pair<std::string, std::string>>;
+
+/// @brief The options write_json records, which a baseline has to share with the run compared against it
+static Settings run_settings(const ThroughputOptions& opts){
+    return {
+        {"iters", std::to_string(opts.iters)},
+        {"affinity", numa::to_string(opts.numa.affinity)},
+        {"placement", numa::to_string(opts.numa.placement)},
+        {"huge_pages", huge_pages::to_string(opts.huge_pages)},
+        {"scheduler", to_string(opts.scheduler.scheduler)},
+        {"task_depth", std::to_string(opts.scheduler.task_depth)},
+    };
+}
+
+struct Baseline{
+    Settings settings;
+    std::vector<ThroughputRun> runs;
+};
+
+/// @brief Reads the settings and runs of a file written by write_json. Not a general json parser.
+static Baseline read_baseline(const std::string& path){
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open " + path);
+
+    Baseline baseline;
+    std::vector<ThroughputRun>& runs = baseline.runs;
+    for (std::string line; std::getline(in, line);){
+        if (line.find("\"threads\":") == std::string::npos){
+            // a "key": value line of the header, the value without its quotes and trailing comma
+            size_t key_start = line.find('"');
+            size_t key_end = key_start == std::string::npos ? key_start : line.find("\":", key_start + 1);
+            if (key_end == std::string::npos) continue;
+            std::string value = line.substr(key_end + 2);
+            std::erase_if(value, [](char c){ return c == '"' || c == ',' || c == ' '; });
+            if (!value.empty() && value != "[") baseline.settings.push_back({line.substr(key_start + 1, key_end - key_start - 1), value});
+            continue;
+        }
+        runs.push_back({
+            .threads = static_cast<size_t>(json_number(line, "threads")),
+            .seconds = json_number(line, "seconds"),
+            .iters_per_sec = json_number(line, "iters_per_sec"),
+            .nodes_per_sec = json_number(line, "nodes_per_sec"),
+            .efficiency = json_number(line, "efficiency"),
+            .peak_rss_mb = json_number(line, "peak_rss_mb")
+        });
+    }
+    if (runs.empty()) throw std::runtime_error("no runs in baseline " + path);
+    return baseline;
+}
+
+/// @return the settings the baseline was recorded with that differ from this run's, as "key: baseline vs this run"
+static std::vector<std::string> mismatched_settings(const ThroughputOptions& opts, const Baseline& baseline){
+    std::vector<std::string> out;
+    for (const auto& [key, value] : run_settings(opts)){
+        auto it = std::ranges::find(baseline.settings, key, &std::pair<std::string, std::string>::first);
+        std::string recorded = it == baseline.settings.end() ? "(missing)" : it->second;
+        if (recorded != value) out.push_back(key + ": " + recorded + " vs " + value);
+    }
+    return out;
+}
+
+/// @return true iff no thread count present in both dropped by more than opts.tolerance
+static bool compare_to_baseline(const ThroughputOptions& opts, const std::vector<ThroughputRun>& runs,
+    const std::vector<ThroughputRun>& baseline){
+
+    std::cout << "\nbaseline: " << opts.baseline_path << " (tolerance " << opts.tolerance * 100 << "%)\n";
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "iters/s" << std::setw(14) << "baseline"
+        << std::setw(12) << "efficiency" << std::setw(12) << "baseline" << '\n';
+
+    bool ok = true;
+    for (const ThroughputRun& r : runs){
+        auto base = std::ranges::find(baseline, r.threads, &ThroughputRun::threads);
+        if (base == baseline.end()) continue;
+
+        bool slower = r.iters_per_sec < base->iters_per_sec * (1.0 - opts.tolerance);
+        bool worse_scaling = r.efficiency < base->efficiency * (1.0 - opts.tolerance);
+        ok = ok && !slower && !worse_scaling;
+
+        std::cout << std::setw(8) << r.threads << std::setw(14) << r.iters_per_sec << std::setw(14) << base->iters_per_sec
+            << std::setw(12) << r.efficiency << std::setw(12) << base->efficiency
+            << (slower ? "  SLOWER" : "") << (worse_scaling ? "  WORSE SCALING" : "") << '\n';
+    }
+    return ok;
+}
+
+static ThroughputOptions parse_args(int argc, char** argv){
+    ThroughputOptions opts;
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+        if (arg == "--iters") opts.iters = std::stoull(argv[++i]);
+        else if (arg == "--max-threads") opts.max_threads = std::stoull(argv[++i]);
+        else if (arg == "--json") opts.json_path = argv[++i];
+        else if (arg == "--baseline") opts.baseline_path = argv[++i];
+        else if (arg == "--tolerance") opts.tolerance = std::stod(argv[++i]);
+        else if (arg == "--affinity") opts.numa.affinity = numa::parse_affinity(argv[++i]);
+        else if (arg == "--placement") opts.numa.placement = numa::parse_placement(argv[++i]);
+        else if (arg == "--huge-pages") opts.huge_pages = huge_pages::parse_mode(argv[++i]);
+        else if (arg == "--scheduler") opts.scheduler.scheduler = parse_scheduler(argv[++i]);
+        else if (arg == "--task-depth") opts.scheduler.task_depth = std::stoull(argv[++i]);
+        else throw std::runtime_error("unknown argument " + arg);
+    }
+    if (opts.iters == 0 || opts.max_threads == 0) throw std::runtime_error("iters and max-threads must be positive");
+    return opts;
+}
+
+int main(int argc, char** argv) {
+    try {
+        ThroughputOptions opts = parse_args(argc, argv);
+
+        // the stored baseline is optional for a checkout without it, one named with --baseline is not
+        namespace fs = std::filesystem;
+        fs::path root = fs::weakly_canonical(fs::path(argv[0])).parent_path().parent_path();
+        fs::path stored_baseline = root / "bench/baselines/throughput.json";
+        const bool named_baseline = !opts.baseline_path.empty();
+        if (!named_baseline){
+            if (fs::exists(stored_baseline)) opts.baseline_path = stored_baseline.string();
+            else std::cout << "no stored baseline at " << stored_baseline.string() << ", not comparing\n";
+        }
+        else if (opts.baseline_path == "none") opts.baseline_path.clear();
+
+        numa::Topology topology = numa::read_topology();
+        std::cout << topology.num_nodes() << " numa node(s), affinity " << numa::to_string(opts.numa.affinity)
+            << ", placement " << numa::to_string(opts.numa.placement) << ", huge pages " << huge_pages::to_string(opts.huge_pages)
+            << ", scheduler " << to_string(opts.scheduler.scheduler) << '\n';
+        huge_pages::set_mode(opts.huge_pages);
+
+        std::vector<ThroughputRun> runs;
+        for (size_t threads : thread_counts(opts.max_threads)){
+            runs.push_back(time_training(opts, threads));
+            runs.back().efficiency = runs.back().iters_per_sec / (static_cast<double>(threads) * runs.front().iters_per_sec);
+        }
+
+        print_runs(runs);
+        if (!opts.json_path.empty()) write_json(opts.json_path, opts, runs);
+        if (opts.baseline_path.empty()) return 0;
+
+        // a baseline recorded with other settings measures something else: an error if asked for by name,
+        // otherwise (the stored one) the comparison is skipped
+        Baseline baseline = read_baseline(opts.baseline_path);
+        std::vector<std::string> mismatched = mismatched_settings(opts, baseline);
+        if (!mismatched.empty()){
+            std::string msg = "baseline " + opts.baseline_path + " was recorded with other settings (baseline vs this run):";
+            for (const std::string& m : mismatched) msg += "\n  " + m;
+            if (named_baseline) throw std::runtime_error(msg);
+            std::cout << '\n' << msg << "\nnot comparing\n";
+            return 0;
+        }
+        if (!compare_to_baseline(opts, runs, baseline.runs)) return 2;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
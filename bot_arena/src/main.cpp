@@ -19,7 +19,8 @@ int main(int , char** argv) {
     CFRSpec spec = load_cfr_config(path, root);
     CFR cfr = load_spec(spec);
 
-    PokerState init_state{spec.starting_stack, spec.big_blind, spec.small_blind};
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
     std::mt19937 rng;
     rng.seed(10);
 
@@ -1,6 +1,8 @@
 /**
  * @file L1_k_means.h
  * @brief L1 version of k-means clustering.
+ * The functions taking points are templated on the point element type T, and instantiated for int and uint8_t
+ * (strengths and cdf counts are stored as uint8_t). Centers are always int.
  * 
  * @note Low hanging fruit: Add some level of parallelization.
  */
@@ -13,13 +15,17 @@
 #include <cstdlib>
 #include <utility>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "k_means_run.h"
 
 namespace L1{
 
-/// @brief L1 distance between two equal-length spans of ints.
+/// @brief L1 distance between two equal-length spans of integers (eg a point and a center).
 /// @warning Does not protect against overflow.
 /// @throws std::runtime_error if sizes differ.
-inline int L1_dist(std::span<const int> a, std::span<const int> b){
+template <typename A, typename B>
+inline int L1_dist(std::span<const A> a, std::span<const B> b){
     if (a.size() != b.size()) throw std::runtime_error("Dimensions dont match in L1 dist");
     int sum = 0;
     for (size_t i = 0; i < a.size(); ++i)
@@ -27,15 +33,27 @@ inline int L1_dist(std::span<const int> a, std::span<const int> b){
     return sum;
 }
 
+/// @brief Upper bound on num_clusters * dim * (number of distinct coordinate values).
+/// Medians are computed from histograms, so the coordinates have to be small integers (strengths, cdf counts).
+inline constexpr size_t max_histogram_size = size_t{1} << 26;
+
 /// @brief Contains a series of vectors reused throughout the clustering algorithm.
 struct ClusterBuffer{
     std::vector<size_t> counts; //counts[i] = number of points assigned to cluster i.
-    std::vector<int> grouped; // Flattened array of points sorted by cluster, then by point index within each cluster
+
+    // Per (cluster, dim) histograms of the point coordinates, used to read off the medians.
+    // histograms[(cluster * dim + d) * num_vals + (x - min_val)] = number of points in cluster with coordinate d equal to x
+    std::vector<uint64_t> histograms;
+    int min_val; // smallest coordinate over all points
+    size_t num_vals; // number of values between the smallest and largest coordinate, inclusive
 
     std::vector<int> assignments; // assignments[i] = cluster to which i^th point belongs
     std::vector<int> prev_assignments; //Same layout as assignments but for prev iteration. 
 
     std::vector<int> centers; //Flattened array of centers
+
+    size_t num_moved; // number of points whose assignment changed in the last assignment step
+    uint64_t inertia; // sum of the L1 distances from the points to their centers in the last assignment step
 };
 
  /// @brief parameters that define behavior of the clustering algorithm
@@ -46,6 +64,7 @@ struct ClusteringParams{
     size_t dim; // dimension of points being clustered
     size_t max_iters; //maximum number of steps the algorihm can run for
     mutable std::mt19937 rng; 
+    k_means::RunOptions run{}; // stopping rule, telemetry and checkpoints, see k_means_run.h
 };
 
 /// @brief Randomly intializes centers for each cluster and writes this data into c_buff.centers
@@ -54,44 +73,76 @@ struct ClusteringParams{
 /// Select c_0 uniformly from the set of points
 /// For i > 0: select c_i from a distribution W on the set of pts, where
 ///  W(p) is proportional to the square of the L1 distance between p and the closest existing center
-void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const std::vector<int>&pts);
+template <typename T>
+void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, std::span<const T> pts);
 
 /// @brief Updates assignment and counts
-/// Writes new assignments into the c_buff.assingments vector and new counts into c_buff.counts
-void update_assignments_and_counts(const ClusteringParams& params, ClusterBuffer& c_buff, const std::vector<int>& pts);
+/// Writes new assignments into the c_buff.assingments vector and new counts into c_buff.counts,
+/// and the number of points that moved since c_buff.prev_assignments and the inertia into c_buff
+template <typename T>
+void update_assignments_and_counts(const ClusteringParams& params, ClusterBuffer& c_buff, std::span<const T> pts);
 
-/// @brief  Writes the data from points into c_buff.grouped
-/// sorted by cluster, then by point index within each cluster
-void update_grouped(const ClusteringParams& params, ClusterBuffer& c_buff, const std::vector<int>& pts);
-
-/// @brief Given updated values for grouped, writes the new centers into c_buff.centers
-/// The i^th center is given by the L1 centroid of the i^th cluster of points
+/// @brief Given updated assignments and counts, writes the new centers into c_buff.centers
+/// The i^th center is given by the L1 centroid of the i^th cluster of points.
+/// Each thread histograms its share of the points per (cluster, dim), the histograms are summed into
+/// c_buff.histograms and the coordinate wise medians are read off them.
 /// @return re_init, where re_init[i] = True iff the i^th center needs to be re-initialized
 /// @note Right now I re-initialize a center iff the cluster for that center is empty.
 /// I should probably do something smarter, like I should have some param and if its sufficiently small I re-init
-std::vector<bool> update_centers(const ClusteringParams& params, ClusterBuffer& c_buff);
+template <typename T>
+std::vector<bool> update_centers(const ClusteringParams& params, ClusterBuffer& c_buff, std::span<const T> pts);
 
 /// @brief Writes the re-initialized centers into c_buff.centers, for which re_init[i] = True 
 /// @warning Does NOT use the same heuristic as the intialization. It uses uniform intialization, which is not ideal.
 /// This is obviously stupid and should be fixed
-void reinit_centers(const ClusteringParams& params,ClusterBuffer& c_buff, const std::vector<int>& pts, const std::vector<bool>& re_init); 
+template <typename T>
+void reinit_centers(const ClusteringParams& params,ClusterBuffer& c_buff, std::span<const T> pts, const std::vector<bool>& re_init); 
                     
 /// @brief Runs one step of the clustering algorithm.
 /// It computes the new cluster assignment and cluster sizes for the current centers. 
-/// It updates c_buff.grouped with this information, 
 /// It computes the new centers for each cluster and re-initializes any points that might need it
-/// It checks if the algorithm has converged and updates the prev_assignments
-/// @return changed, true iff at least one point was moved to a different cluster 
-bool clustering_step(const ClusteringParams& params, ClusterBuffer& c_buff, const std::vector<int>& pts);
+/// It updates the prev_assignments
+/// @return number of points moved to a different cluster
+template <typename T>
+size_t clustering_step(const ClusteringParams& params, ClusterBuffer& c_buff, std::span<const T> pts);
 
 /// @brief Runs L1 k-means on "pts" until convergence or max iterations.
+/// Converged means an iteration moved at most params.run.min_moved_frac of the points. If params.run.checkpoint_dir
+/// is set, the run is snapshotted there every params.run.checkpoint_every iterations (never at 0) and resumes from an
+/// existing snapshot.
 /// @param params  number of clusters, dimension of vectors, number of points, and maximum number of iterations
 /// @param pts: Flattened array of "params.num_pts" vectors of dimension "params.dim"
 /// Given points [x_0, x_1, ...] with x_i[j] the j-th entry of the i-th vector:
 ///  pts = [x_0[0], ..., x_0[dim-1], x_1[0], ..., x_1[dim-1], ...]
 /// @return {assignments, centroids}, assignments[i] is the cluster to which the i^th point is assigned
 /// centroids : Flattened array of the "params.num_clusters" centroids of each cluster
-///@throw Runtime error if pts.size() != params.num_pts*params.dim
-std::pair<std::vector<int>,std::vector<int>> l1_k_means(const ClusteringParams& params, const std::vector<int>& pts);
+///@throw Runtime error if pts.size() != params.num_pts*params.dim, if the coordinates span too many values
+/// for the median histograms (see max_histogram_size), or if a checkpoint does not match params
+/// @param stats if not null, receives the number of iterations run, the last iteration's moved count and inertia,
+/// and the total time
+template <typename T>
+std::pair<std::vector<int>,std::vector<int>> l1_k_means(const ClusteringParams& params, std::span<const T> pts,
+    k_means::IterationStats* stats = nullptr);
+
+
+/// @brief Settings for streaming_l1_k_means.
+struct StreamingParams{
+    size_t chunk_pts; // points handed to the threads at a time, keeps every thread reading the same window of pts
+    size_t sample_pts; // number of points drawn uniformly at random (with replacement) to seed the centers on
+};
+
+/// @brief Receives the final assignments of consecutive chunks of points, in order.
+using AssignmentSink = std::function<void(std::span<const int>)>;
+
+/// @brief Out-of-core version of l1_k_means for point sets that do not fit in memory, eg a MappedMatrix.
+/// Each iteration is one pass over pts, stream.chunk_pts points at a time, split between the threads,
+/// which only keep O(num_clusters * dim) histograms. No per point state is kept: the centers are seeded
+/// (using init_centers) on a uniform sample of stream.sample_pts points, the algorithm stops once an
+/// iteration leaves the centers unchanged, and a final pass hands the assignments to sink chunk by chunk.
+/// @return centroids : Flattened array of the "params.num_clusters" centroids of each cluster
+///@throw Runtime error if pts.size() != params.num_pts*params.dim or the stream settings are unusable
+template <typename T>
+std::vector<int> streaming_l1_k_means(const ClusteringParams& params, const StreamingParams& stream,
+    std::span<const T> pts, const AssignmentSink& sink);
 
 }
\ No newline at end of file
@@ -18,8 +18,17 @@ struct Artifacts {
     std::filesystem::path flop_ctrs_verts;
     std::filesystem::path flop_assignments;
     std::filesystem::path flop_ev_sdev;
+
+    // k-means snapshots, one subdirectory per clustering stage, taken every checkpoint_every iterations (0: none)
+    std::filesystem::path checkpoints;
+    size_t checkpoint_every;
 };
 
+/// @brief art.checkpoints / stage, or empty (no snapshots) if art.checkpoint_every is 0
+inline std::filesystem::path stage_checkpoint_dir(const Artifacts& art, const std::filesystem::path& stage){
+    return art.checkpoint_every > 0 ? art.checkpoints / stage : std::filesystem::path{};
+}
+
 struct ClusteringConfig {
     Artifacts art;
 
@@ -34,6 +43,17 @@ struct ClusteringConfig {
     size_t flop_max_iters;
     size_t flop_center_support;
 
+    // k-means stops once an iteration moves at most this fraction of the points
+    double min_moved_frac;
+
+    // turn and flop clustering run this many seeds (seed, seed + 1, ...) concurrently and keep the lowest inertia
+    size_t restarts;
+
+    // stream the features from disk with mmap instead of loading them (turn and flop clusters)
+    bool streaming;
+    size_t stream_chunk_pts;
+    size_t stream_sample_pts;
+
     uint32_t seed;
 };
 
@@ -46,6 +66,6 @@ void run_turn_cdfs(const ClusteringConfig& cfg);
 void run_turn_clusters(const ClusteringConfig& cfg);
 void run_turn_distance_matrix(const ClusteringConfig& cfg);
 
-void run_flop_multisets(const ClusteringConfig& cfg);
-void run_flop_clusters(const ClusteringConfig& cfg);
-void run_flop_ev_sdev(const ClusteringConfig& cfg);
\ No newline at end of file
+// writes the flop multisets and the flop ev and sdev in the same pass
+void run_flop_features(const ClusteringConfig& cfg);
+void run_flop_clusters(const ClusteringConfig& cfg);
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 #include <string>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <random>
 #include <limits>
 #include <vector>
 #include <span>
 #include <stdexcept>
+#include "k_means_run.h"
 
 /**
  * @file emd_k_means.h
@@ -18,8 +22,9 @@
  * @note This code uses non-standard encodings of probabily distributions.
  * Point encoding: each point is a distribution over the graph's vertices encoded as a multiset
  * We limit ourselves to distributions which can be represented empirically as the outcomes of `multiset_size` draws from the vertex
- * set. A point is a vector x of length `multiset_size` with x[i] the vertex drawn
- * on the i-th draw, so vertex v carries probability (number of entries of x equal to v) / multiset_size.
+ * set. A point is stored as a count histogram h of length `num_verts`, with h[v] the number of draws
+ * that landed on vertex v, so vertex v carries probability h[v] / multiset_size.
+ * Counts are stored as uint8_t, so multiset_size must be at most 255.
  * 
  * Center encoding: centers are also distributions over the graph's vertices. 
  * @warning Centers are stored differently from points.
@@ -30,10 +35,23 @@
 
 namespace emd{
 
+/// @brief Upper bound on the number of distinct vertices in a multiset and on the center support.
+/// Lets approx_EMD keep all of its scratch on the stack.
+inline constexpr size_t max_support = 256;
+
+/// @brief Number of anchor vertices used to lower bound the EMD during assignment.
+/// For an anchor r, f(v) = weight(r, v) is 1-Lipschitz under the ground distance, so
+/// |E_p[f] - E_c[f]| <= EMD(p, c). The bound is the max of this gap over the anchors.
+inline constexpr size_t num_anchors = 4;
+
+/// @brief Expected distance to each anchor under a distribution. See num_anchors.
+using Potentials = std::array<float, num_anchors>;
+
 /// @brief Sparse center representation as described above.
 struct Center{
     std::vector<float>wts;
     std::vector<int> verts;
+    bool operator==(const Center&) const = default;
 };
 
 /// @brief A buffer used to store information about a given center used in approx_EMD.
@@ -44,27 +62,31 @@ struct EMDCache{
     std::vector<int> ordered_clusters;
 };
 
-/// @brief A buffer used to store vectors used in the approx_EMD. 
-/// See paper for definitions of targets/mean_remaining/done.
-struct EMDScratch{
-    std::vector<float> targets;
-    std::vector<float> mean_remaining;
-    std::vector<bool> done;
+/// @brief A multiset collapsed to its distinct vertices: the point places mass wts[i] on verts[i].
+/// Built from a histogram once and then compared against every center.
+struct SparseMultiset{
+    std::array<int, max_support> verts;
+    std::array<float, max_support> wts;
+    size_t size = 0;
 };
 
 /// @brief A struct used to hold a ton of vectors used throughout the clustering process.
 struct ClusterBuffer{
     std::vector<float> min_dists; // min_dist[i] = distance from i^th multiset to closest center
 
-    // Sparse multiset representations, grouped by cluster and ordered by
-    // point index within each cluster.
-    std::vector<int> grouped;
+    // dense_reps[c * num_verts + v] = total count of vertex v over the multisets assigned to cluster c
+    std::vector<int> dense_reps;
 
     std::vector<int> assignments; // assignments[i] gives the cluster to which the i^th point is assigned
     std::vector<int> prev_assignments;
 
     std::vector<size_t> counts; // counts[i] = number of points assigned to i^th cluster
     std::vector<Center> centers; // centers[i] = center of i^th cluster
+
+    std::vector<int> anchors; // vertices used for the EMD lower bound, see num_anchors
+
+    size_t num_moved; // number of multisets whose assignment changed in the last assignment step
+    double inertia; // sum of the approximate EMDs from the multisets to their centers in the last assignment step
 };
 
 /// @brief Set of params which define the behavior of the clustering algorithm.
@@ -76,23 +98,48 @@ struct Params{
     // We quantize each center to have a supports of size = center_support
     size_t center_support;
 
-    size_t multiset_size; // The size of the multisets
-    size_t num_multisets; // number of multisets we are clustering
+    size_t multiset_size; // The size of the multisets, ie the sum of each histogram
+    size_t num_multisets; // number of multisets we are clustering. Each one is a histogram of length num_verts
 
     // weight_matrix[i,j] = weight of edge from vertex i to vertex j. 
-    // weight_matrix is assumed to be symmetric and is flattened in row-major format
+    // weight_matrix is assumed to be symmetric and to satisfy the triangle inequality (the assignment step's
+    // lower bound relies on this). It is flattened in row-major format
     // ie weight_matrix[i,j] = weight_matrix[i*num_verts + j]
     std::vector<float> weight_matrix; 
 
     size_t max_iters;
     mutable std::mt19937 rng;
+    k_means::RunOptions run{}; // stopping rule, telemetry and checkpoints, see k_means_run.h
 };
 
 /// @brief Configures emd cache values for the given cente
 void fill_emd_cache(const Params& params, const Center& ctr, EMDCache& emd_cache);
 
+/// @brief Configures one emd cache per center, building them in parallel.
+/// Resizes emd_caches to centers.size()
+void fill_emd_caches(const Params& params, const std::vector<Center>& centers, std::vector<EMDCache>& emd_caches);
+
+/// @brief Collapses a histogram of length params.num_verts into its distinct vertices and their probability mass.
+/// @throws std::runtime_error if the histogram has the wrong length
+void fill_sparse_multiset(const Params& params, std::span<const uint8_t> histogram, SparseMultiset& sparse);
+
 /// @brief Approximately computes and returns EMD distance between center and multiset
-float approx_EMD(const Params& params, const Center& ctr, std::span<const int> multiset, const EMDCache& emd_cache, EMDScratch& emd_scratch);
+/// Works on the distinct vertices of the multiset, each carrying its full weight, so duplicate draws
+/// cost nothing extra.
+/// @param cutoff The greedy matching stops as soon as the running cost exceeds cutoff, in which case
+/// the partial cost (which is > cutoff) is returned. Costs only grow, so this never hides a closer center.
+float approx_EMD(const Params& params, const Center& ctr, const SparseMultiset& multiset, const EMDCache& emd_cache,
+    float cutoff = std::numeric_limits<float>::max());
+
+/// @brief Picks up to num_anchors vertices by farthest point traversal of the weight matrix, starting at vertex 0.
+std::vector<int> pick_anchors(const Params& params);
+
+/// @brief Writes the expected distance from each anchor under the distribution placing mass wts[i] on verts[i].
+void fill_potentials(const Params& params, const std::vector<int>& anchors,
+    std::span<const int> verts, std::span<const float> wts, Potentials& potentials);
+
+/// @brief Adds a histogram of length params.num_verts into dense_rep.
+void add_to_dense(const Params& params, std::span<const uint8_t> histogram, std::vector<int>& dense_rep);
 
 /// @brief Quantizes a dense, unnormalized multiset over the vertices into a Center.
 /// then takes the params.center_support vertices with the largest counts and normalizes
@@ -104,17 +151,17 @@ void clipped_dense_center(const Params& params, Center& ctr, const std::vector<i
 
 /// @brief Updates assignment and counts
 /// Writes new assignments into the c_buff.assingments vector and new counts into c_buff.counts
+/// Refills emd_caches for the current centers, then streams the multisets once, comparing each
+/// multiset against every center. The previous center of a multiset is tried first; any other center whose
+/// anchor lower bound exceeds the best distance so far is skipped, and the rest are abandoned early once
+/// they exceed it. Assignments match the exhaustive search (lowest index wins ties).
 void update_assignments_and_counts(const Params& params, ClusterBuffer& c_buff,
- const std::vector<int>& multisets, EMDCache& emd_cache);
-
-
-/// @brief Writes the data from points into c_buff.grouped
-/// sorted by cluster, then by point index within each cluster
-void update_grouped(const Params& params, ClusterBuffer& c_buff, const std::vector<int>& multisets);
+ std::span<const uint8_t> multisets, std::vector<EMDCache>& emd_caches);
 
 
-
-/// @brief Given updated `c_buff.grouped`, writes the new centers into `c_buff.centers`.
+/// @brief Given updated assignments and counts, writes the new centers into `c_buff.centers`.
+/// Each thread sums the histograms of its share of the multisets per cluster, and these partial
+/// sums are reduced into `c_buff.dense_reps`.
 /// Each center is computed by embedding the cluster's points into R^N, where N
 /// is the number of vertices and coordinate v holds the probability assigned to
 /// vertex v. The center is the coordinate-wise mean of the cluster's points in
@@ -124,13 +171,13 @@ void update_grouped(const Params& params, ClusterBuffer& c_buff, const std::vect
 /// get decent clustering ! 
 /// @note Right now I re-initialize a center iff the cluster for that center is empty.
 /// I should probably do something smarter.
-std::vector<bool> update_centers(const Params& params, ClusterBuffer& c_buff);
+std::vector<bool> update_centers(const Params& params, ClusterBuffer& c_buff, std::span<const uint8_t> multisets);
 
 /// @brief Writes the re-initialized centers into c_buff.centers, for which re_init[i] = True 
 /// @warning Does NOT use the same heuristic as the intialization. It uses uniform intialization, which is not ideal.
 /// This is obviously stupid and should be fixed
 void reinit_centers(const Params& params, ClusterBuffer& c_buff,
-     const std::vector<int>& multisets, const std::vector<bool>& reseeded);
+     std::span<const uint8_t> multisets, const std::vector<bool>& reseeded);
 
 
 /// @brief Randomly intializes centers for each cluster and writes this data into c_buff.centers
@@ -140,24 +187,50 @@ void reinit_centers(const Params& params, ClusterBuffer& c_buff,
 /// For i > 0: select c_i from a distribution W on the set of pts, where
 ///  W(p) is proportional to the square of the EMD between p and the closest existing center
 void init_centers(const Params& params, ClusterBuffer& c_buff, 
-    const std::vector<int>&multisets, EMDCache& emd_cache);
+    std::span<const uint8_t> multisets, EMDCache& emd_cache);
 
 
 /// @brief Runs one step of the clustering algorithm.
 /// It computes the new cluster assignment and cluster sizes for the current centers. 
-/// It updates c_buff.grouped with this information, 
 /// It computes the new centers for each cluster and re-initializes any points that might need it
-/// It checks if the algorithm has converged and updates the prev_assignments
-/// @return changed, true iff at least one point was moved to a different cluster 
-bool clustering_step(const Params& params, ClusterBuffer& c_buff, const std::vector<int>& multisets, EMDCache& emd_cache);
+/// It updates the prev_assignments
+/// @return number of multisets moved to a different cluster
+size_t clustering_step(const Params& params, ClusterBuffer& c_buff, std::span<const uint8_t> multisets, std::vector<EMDCache>& emd_caches);
 
 /// @brief Runs an approximately EMD k means style clustering algorithm on multisets over vertices in finite graphs
+/// Stops once an iteration moves at most params.run.min_moved_frac of the multisets. If params.run.checkpoint_dir
+/// is set, the run is snapshotted there every params.run.checkpoint_every iterations (never at 0) and resumes from an
+/// existing snapshot.
 /// @param params Encodes the settings for the quantization algorithm
-/// @param multisets Sparsely encoded multisets we wish to cluster
-///@throw Runtime error if multisets.size() != params.num_mutlisets*params.multiset_size
+/// @param multisets Histogram encoded multisets we wish to cluster, flattened row-major
+///@throw Runtime error if multisets.size() != params.num_mutlisets*params.num_verts,
+/// or if params.center_support / the multisets do not fit in max_support, or if a checkpoint does not match params
 /// @return {assignments, centers}
 /// assignments[i] is the cluster to which the i^th point is assigned
 /// centers - Flattened array of the "params.num_clusters" centroids of each cluster
-std::pair<std::vector<int>, std::vector<Center>> emd_k_means(const Params& params, const std::vector<int>& multisets);
+/// @param stats if not null, receives the number of iterations run, the last iteration's moved count and inertia,
+/// and the total time
+std::pair<std::vector<int>, std::vector<Center>> emd_k_means(const Params& params, std::span<const uint8_t> multisets,
+    k_means::IterationStats* stats = nullptr);
    
+
+/// @brief Settings for streaming_emd_k_means.
+struct StreamingParams{
+    size_t chunk_multisets; // multisets handed to the threads at a time, keeps every thread reading the same window
+    size_t sample_multisets; // number of multisets drawn uniformly at random (with replacement) to seed the centers on
+};
+
+/// @brief Receives the final assignments of consecutive chunks of multisets, in order.
+using AssignmentSink = std::function<void(std::span<const int>)>;
+
+/// @brief Out-of-core version of emd_k_means for multisets that do not fit in memory, eg a MappedMatrix.
+/// Each iteration is one pass over the multisets, stream.chunk_multisets at a time, split between the threads,
+/// which only keep O(num_clusters * num_verts) counts. No per multiset state is kept: the centers are seeded
+/// (using init_centers) on a uniform sample of stream.sample_multisets multisets, the algorithm stops once an
+/// iteration leaves the centers unchanged, and a final pass hands the assignments to sink chunk by chunk.
+/// @return centers
+///@throw Runtime error under the same conditions as emd_k_means, or if the stream settings are unusable
+std::vector<Center> streaming_emd_k_means(const Params& params, const StreamingParams& stream,
+    std::span<const uint8_t> multisets, const AssignmentSink& sink);
+
 }
\ No newline at end of file
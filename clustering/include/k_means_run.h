@@ -0,0 +1,104 @@
+/**
+ * @file k_means_run.h
+ * @brief Stopping rule, per iteration telemetry and resumable snapshots shared by the L1 and EMD k-means.
+ */
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <omp.h>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace k_means{
+
+/// @brief Optional behavior of a k-means run. The defaults reproduce a plain run.
+struct RunOptions{
+    // stop once an iteration moves at most this fraction of the points. 0 stops only when no point moves
+    double min_moved_frac = 0.0;
+
+    // if set, the centers, assignments and rng are snapshotted here every checkpoint_every iterations, and a run
+    // finding a snapshot here resumes from it instead of seeding. Resuming reproduces the uninterrupted run.
+    // @warning the snapshot does not record the params, the directory must be cleared after changing them
+    // (run_stage_graph does this for the clustering stages)
+    std::filesystem::path checkpoint_dir;
+    size_t checkpoint_every = 1; // each snapshot rewrites every assignment, so big runs space them out
+
+    bool verbose = false; // print an IterationStats line per iteration
+    std::string label; // printed in front of the log lines, eg "[seed 43] " to tell concurrent restarts apart
+};
+
+/// @brief Stats of one iteration, or of a whole run: iterations run, last iteration's moved and inertia, total time
+struct IterationStats{
+    size_t iter;
+    size_t moved; // points assigned to a different cluster than in the previous iteration
+    double inertia; // sum over the points of the distance to their center
+    double seconds;
+};
+
+/// @brief true iff the run should stop after an iteration that moved "moved" of "num_pts" points
+inline bool has_converged(const RunOptions& opts, size_t moved, size_t num_pts){
+    return static_cast<double>(moved) <= opts.min_moved_frac * static_cast<double>(num_pts);
+}
+
+/// @brief true iff a run that has done iters_done iterations should snapshot now
+inline bool should_checkpoint(const RunOptions& opts, size_t iters_done){
+    return !opts.checkpoint_dir.empty() && opts.checkpoint_every > 0 && iters_done % opts.checkpoint_every == 0;
+}
+
+/// @brief Prints one line of stats, safe to call from concurrent runs
+void log_iteration(const std::string& name, size_t num_pts, const IterationStats& stats);
+
+/// @brief Runs run_one(restart) for every restart in [0, restarts), several at a time.
+/// The threads are split between the restarts, which get omp_get_max_threads() / (concurrent restarts) threads
+/// each for their own parallel regions, so the shared point data is read by all of them at once.
+/// @throw rethrows the first exception thrown by a restart, after all of them finish
+template <typename RunOne>
+void run_restarts(size_t restarts, RunOne&& run_one){
+    const int total_threads = omp_get_max_threads();
+    const int outer = static_cast<int>(std::min<size_t>(restarts, static_cast<size_t>(total_threads)));
+    const int inner = std::max(1, total_threads / std::max(1, outer));
+
+    const int prev_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(std::max(prev_levels, 2));
+
+    std::vector<std::exception_ptr> errors(restarts);
+    #pragma omp parallel for num_threads(outer) schedule(dynamic, 1)
+    for (size_t restart = 0; restart < restarts; ++restart){
+        omp_set_num_threads(inner);
+        try {
+            run_one(restart);
+        }
+        catch (...) {
+            errors[restart] = std::current_exception();
+        }
+    }
+
+    omp_set_max_active_levels(prev_levels);
+    for (const std::exception_ptr& error : errors){
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+/// @brief Logs the final stats of every restart and picks the one with the lowest inertia (lowest index wins ties).
+/// @param seeds seeds[i] is the seed restart i ran with
+size_t best_restart(const std::string& name, const std::vector<uint32_t>& seeds, const std::vector<IterationStats>& stats);
+
+/// @brief Atomically replaces the snapshot in dir: write_state writes the run's matrices into the directory
+/// it is handed, and the snapshot only replaces the previous one once everything is written.
+/// @param last stats of the run so far, last.iter is the iteration the run would resume from
+void save_checkpoint(const std::filesystem::path& dir, const IterationStats& last, const std::mt19937& rng,
+    const std::function<void(const std::filesystem::path&)>& write_state);
+
+/// @brief Loads the snapshot in dir, if any: restores rng and hands the snapshot directory to read_state.
+/// @return the stats saved with the snapshot (seconds is 0), nullopt if there is no snapshot
+std::optional<IterationStats> load_checkpoint(const std::filesystem::path& dir, std::mt19937& rng,
+    const std::function<void(const std::filesystem::path&)>& read_state);
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "clustering_config.h"
+
+/**
+ * @file stage_graph.h
+ * @brief Runs the clustering stages as a dependency graph with cached artifacts.
+ *
+ * Every artifact gets a sidecar "<artifact>.meta" file holding the key of the run that produced it.
+ * A stage's key hashes its name, its params string and the keys of its inputs (or their contents if an input has no
+ * .meta file), so changing a param reruns that stage and everything downstream of it, and nothing else.
+ * Stages whose outputs all carry the current key are skipped. Stale outputs are deleted before a stage reruns.
+ */
+
+using StageFunc = void(*)(const ClusteringConfig&);
+
+struct Stage {
+    std::string name;
+    StageFunc func;
+    std::vector<std::filesystem::path> inputs;
+    std::vector<std::filesystem::path> outputs;
+    std::string params; // every config value the stage reads, other than paths
+
+    // directories the stage may resume from (eg k-means checkpoints), cleared whenever the stage's key changes
+    std::vector<std::filesystem::path> scratch = {};
+};
+
+/// @brief Runs the stages, each as soon as the stages producing its inputs are done, so independent stages overlap.
+/// @param stages a stage can only take inputs produced by stages listed before it, or files that already exist
+/// @throw Runtime error if a stage fails (after the stages already running finish), or an input is missing
+void run_stage_graph(const std::vector<Stage>& stages, const ClusteringConfig& cfg);
@@ -1,93 +1,136 @@
 #include "L1_k_means.h"
+#include "matrix_loader.h"
+#include <chrono>
 #include <string>
 #include <algorithm>
 #include <random>
 #include <iostream>
 #include <climits>
+#include <optional>
 #include <vector>
 #include <span>
 
 using namespace std;
+namespace fs = std::filesystem;
 namespace L1{
 
-void update_assignments_and_counts(const ClusteringParams& params, ClusterBuffer& c_buff, const vector<int>& pts) {
+template <typename T>
+static int nearest_center(const ClusteringParams& params, const vector<int>& centers, span<const T> pt_span, int& best_dist) {
 
-    c_buff.assignments.assign(params.num_pts, 0);
-    c_buff.counts.assign(params.num_clusters, 0);
+    best_dist = INT_MAX;
+    int best_center = 0;
 
-    for (size_t pt_idx = 0; pt_idx < params.num_pts; ++pt_idx) {
+    for (size_t center_idx = 0; center_idx < params.num_clusters; ++center_idx) {
 
-        int best_dist = INT_MAX;
-        int best_center = 0;
+        span<const int>ctr_span(&centers[center_idx * params.dim], params.dim);
+        int d = L1_dist(pt_span, ctr_span);
 
-        for (size_t center_idx = 0; center_idx < params.num_clusters; ++center_idx) {
+        if (d < best_dist) { 
+            best_dist = d; 
+            best_center = static_cast<int>(center_idx); 
+        }
+    }
+    return best_center;
+}
 
-            span<const int>pt_span(&pts[pt_idx * params.dim], params.dim);
-            span<const int>ctr_span(&c_buff.centers[center_idx * params.dim], params.dim);
-            int d = L1_dist(pt_span, ctr_span);
+template <typename T>
+void update_assignments_and_counts(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts) {
 
-            if (d < best_dist) { 
-                best_dist = d; 
-                best_center = static_cast<int>(center_idx); 
-            }
-        }
+    c_buff.assignments.assign(params.num_pts, 0);
+    c_buff.counts.assign(params.num_clusters, 0);
+    c_buff.num_moved = 0;
+    c_buff.inertia = 0;
+    if (c_buff.prev_assignments.size() != params.num_pts) c_buff.prev_assignments.assign(params.num_pts, -1);
+
+    for (size_t pt_idx = 0; pt_idx < params.num_pts; ++pt_idx) {
+        int best_dist;
+        int best_center = nearest_center(params, c_buff.centers, pts.subspan(pt_idx * params.dim, params.dim), best_dist);
         c_buff.counts[best_center] += 1;
         c_buff.assignments[pt_idx] = best_center;
+        c_buff.num_moved += (best_center != c_buff.prev_assignments[pt_idx]);
+        c_buff.inertia += static_cast<uint64_t>(best_dist);
     }
 }
 
-void update_grouped(const ClusteringParams& params, ClusterBuffer& c_buff, const vector<int>& pts) {
-    //Reshaping data into grouped makes it nice to use the L1 dist functions ince the data it wants to use is all contiguos in the array
+template <typename T>
+static void add_to_histogram(const ClusteringParams& params, const ClusterBuffer& c_buff,
+    size_t ctr, span<const T> pt_span, vector<uint64_t>& histograms) {
 
-    vector<size_t> offsets(params.num_clusters * params.dim, 0);
-    size_t running = 0;
+    size_t row = ctr * params.dim;
+    for (size_t dim = 0; dim < params.dim; ++dim) {
+        size_t val = static_cast<size_t>(static_cast<int>(pt_span[dim]) - c_buff.min_val);
+        ++histograms[(row + dim) * c_buff.num_vals + val];
+    }
+}
 
-    for (size_t center_idx = 0; center_idx < params.num_clusters; ++center_idx) {
-        for (size_t dim = 0; dim <params.dim; ++dim) {
-            offsets[params.dim * center_idx + dim] = running;
-            running += c_buff.counts[center_idx];
+static vector<bool> centers_from_histograms(const ClusteringParams& params, ClusterBuffer& c_buff) {
+
+    c_buff.centers.resize(params.num_clusters * params.dim);
+    vector<bool> center_reseeded(params.num_clusters);
+
+    for (size_t ctr = 0; ctr < params.num_clusters; ++ctr) {
+        if (c_buff.counts[ctr] == 0){
+            center_reseeded[ctr] = true;
+            continue;
+        } 
+
+        //same element nth_element(.., block_len / 2, ..) would pick: the first value whose cumulative count passes half
+        uint64_t half = c_buff.counts[ctr] / 2;
+        for (size_t dim = 0; dim < params.dim; ++dim) {
+            const uint64_t* hist = &c_buff.histograms[(ctr * params.dim + dim) * c_buff.num_vals];
+            uint64_t cum = 0;
+            size_t val = 0;
+            while (cum + hist[val] <= half) cum += hist[val++];
+            c_buff.centers[params.dim * ctr + dim] = c_buff.min_val + static_cast<int>(val);
         }
     }
 
-    c_buff.grouped.resize(params.num_pts*params.dim);   
+    return center_reseeded;
+}
 
-    for (size_t pt_idx = 0; pt_idx < params.num_pts; ++pt_idx) {
-        int assigned_center = c_buff.assignments[pt_idx];
-        for (size_t dim_idx = 0; dim_idx < params.dim; ++dim_idx) {
-            size_t gpd_idx = offsets[params.dim * assigned_center + dim_idx];
-            c_buff.grouped[gpd_idx] = pts[pt_idx * params.dim + dim_idx];
-            ++offsets[params.dim * assigned_center + dim_idx];
-        }
+template <typename T>
+static void set_value_range(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts) {
+
+    int min_val = INT_MAX;
+    int max_val = INT_MIN;
+
+    #pragma omp parallel for reduction(min:min_val) reduction(max:max_val) schedule(static)
+    for (size_t i = 0; i < pts.size(); ++i) {
+        min_val = min(min_val, static_cast<int>(pts[i]));
+        max_val = max(max_val, static_cast<int>(pts[i]));
     }
+
+    c_buff.min_val = pts.empty() ? 0 : min_val;
+    c_buff.num_vals = pts.empty() ? 1 : static_cast<size_t>(static_cast<int64_t>(max_val) - min_val) + 1;
+    if (params.num_clusters * params.dim * c_buff.num_vals > max_histogram_size)
+        throw runtime_error("too many distinct coordinate values for the median histograms");
 }
 
-vector<bool> update_centers(const ClusteringParams& params, ClusterBuffer& c_buff) {
+template <typename T>
+vector<bool> update_centers(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts) {
     //updates c_buff.centers using L1 centroid (this is the coordinate wise median)
 
-    c_buff.centers.resize(params.num_clusters * params.dim);
-    size_t running = 0;
-
-    vector<bool> center_reseeded(params.num_clusters);
-    for (size_t ctr = 0; ctr < params.num_clusters; ++ctr) {
-        for (size_t dim = 0; dim < params.dim; ++dim) {
-            size_t block_len = c_buff.counts[ctr];
-            auto it = c_buff.grouped.begin() + running;
-            running += block_len;      
+    c_buff.histograms.assign(params.num_clusters * params.dim * c_buff.num_vals, 0);
 
-            if (c_buff.counts[ctr] == 0){
-                center_reseeded[ctr] = true;
-                continue;
-            } 
+    #pragma omp parallel
+    {
+        vector<uint64_t> local(c_buff.histograms.size(), 0);
 
-            nth_element(it, it + block_len / 2, it + block_len); 
-            c_buff.centers[params.dim * ctr + dim] = *(it + block_len / 2);
+        #pragma omp for schedule(static) nowait
+        for (size_t pt_idx = 0; pt_idx < params.num_pts; ++pt_idx) {
+            size_t ctr = static_cast<size_t>(c_buff.assignments[pt_idx]);
+            add_to_histogram(params, c_buff, ctr, pts.subspan(pt_idx * params.dim, params.dim), local);
         }
+
+        #pragma omp critical
+        for (size_t i = 0; i < local.size(); ++i) c_buff.histograms[i] += local[i];
     }
 
-    return center_reseeded;
+    return centers_from_histograms(params, c_buff);
 }
 
-void reinit_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const vector<int>& pts, const vector<bool>& reinit) {
+template <typename T>
+void reinit_centers(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts, const vector<bool>& reinit) {
 
     uniform_int_distribution<size_t> pick(0, params.num_pts - 1);
 
@@ -100,21 +143,22 @@ void reinit_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const
     }
 }  
 
-bool clustering_step(const ClusteringParams& params, ClusterBuffer& c_buff, const vector<int>& pts){
+template <typename T>
+size_t clustering_step(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts){
 
     c_buff.prev_assignments.swap(c_buff.assignments);              
 
     update_assignments_and_counts(params, c_buff ,pts); 
-    update_grouped(params, c_buff, pts);
-    vector<bool> reinit= update_centers(params, c_buff);
+    vector<bool> reinit= update_centers(params, c_buff, pts);
 
     if (find(reinit.begin(), reinit.end(), true) != reinit.end()){
         reinit_centers(params, c_buff, pts, reinit);
     }
-    return c_buff.assignments != c_buff.prev_assignments;
+    return c_buff.num_moved;
 }
 
-void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const vector<int>&pts){
+template <typename T>
+void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, span<const T> pts){
     //heuristic initialization of c_buff.centers with distance caching
     c_buff.centers.resize(params.num_clusters*params.dim);
 
@@ -133,7 +177,7 @@ void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const v
         for(size_t p = 0; p < params.num_pts; ++p){
             //p is the pt idx
 
-            span<const int>pt_span(&pts[p * params.dim], params.dim);
+            span<const T>pt_span(&pts[p * params.dim], params.dim);
             span<const int>ctr_span(&c_buff.centers[(c-1) * params.dim], params.dim);
             uint64_t dist = L1_dist(pt_span, ctr_span);
 
@@ -161,23 +205,192 @@ void init_centers(const ClusteringParams& params, ClusterBuffer& c_buff, const v
     }
 }
 
-pair<vector<int>,vector<int>> l1_k_means(const ClusteringParams& params, const vector<int>& pts){
+static void save_state(const ClusteringParams& params, const ClusterBuffer& c_buff, const fs::path& dir){
+    MatrixHeader center_header{
+        .num_rows = params.num_clusters,
+        .num_cols = params.dim,
+        .bytes_per_elt = sizeof(int),
+        .is_signed = true,
+        .is_float = false
+    };
+    write_matrix_and_header<int>((dir / "centers.npy").string(), center_header, c_buff.centers);
+
+    MatrixHeader assignment_header{
+        .num_rows = params.num_pts,
+        .num_cols = 1,
+        .bytes_per_elt = sizeof(int),
+        .is_signed = true,
+        .is_float = false
+    };
+    write_matrix_and_header<int>((dir / "assignments.npy").string(), assignment_header, c_buff.assignments);
+}
+
+static void load_state(const ClusteringParams& params, ClusterBuffer& c_buff, const fs::path& dir){
+    auto [centers, center_header] = load_matrix_and_header<int>((dir / "centers.npy").string());
+    auto [assignments, assignment_header] = load_matrix_and_header<int>((dir / "assignments.npy").string());
+
+    if (center_header.num_rows != params.num_clusters || center_header.num_cols != params.dim
+        || assignment_header.num_rows != params.num_pts){
+        throw runtime_error("checkpoint does not match params: " + dir.string());
+    }
+    c_buff.centers = std::move(centers);
+    c_buff.assignments = std::move(assignments);
+}
+
+template <typename T>
+pair<vector<int>,vector<int>> l1_k_means(const ClusteringParams& params, span<const T> pts, k_means::IterationStats* stats){
     if (pts.size() != params.dim* params.num_pts) throw runtime_error("pt size doesnt match param specs");
 
     ClusterBuffer c_buff;
-    c_buff.assignments.resize(params.num_pts);
-    c_buff.prev_assignments.assign(params.num_pts, -1);
-    c_buff.grouped.resize(params.num_pts*params.dim);
+    set_value_range(params, c_buff, pts);
+
+    c_buff.assignments.assign(params.num_pts, -1);
     c_buff.counts.resize(params.num_clusters);
     c_buff.centers.resize(params.num_clusters);
 
-    init_centers(params, c_buff, pts);
+    const k_means::RunOptions& run = params.run;
+    size_t first_iter = 0;
+    optional<k_means::IterationStats> resumed;
+    if (!run.checkpoint_dir.empty()){
+        resumed = k_means::load_checkpoint(run.checkpoint_dir, params.rng,
+            [&](const fs::path& dir) { load_state(params, c_buff, dir); });
+    }
+    if (!resumed) init_centers(params, c_buff, pts);
+    else if (k_means::has_converged(run, resumed->moved, params.num_pts)) first_iter = params.max_iters; // it had already stopped
+    else first_iter = resumed->iter;
 
-    for (size_t iter = 0; iter < params.max_iters; ++iter) {
-        bool changed = clustering_step(params, c_buff,  pts);
-        if (!changed) break;    
+    chrono::steady_clock::time_point run_start = chrono::steady_clock::now();
+    k_means::IterationStats last = resumed.value_or(k_means::IterationStats{.iter = 0, .moved = 0, .inertia = 0.0, .seconds = 0.0});
+
+    for (size_t iter = first_iter; iter < params.max_iters; ++iter) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t moved = clustering_step(params, c_buff,  pts);
+
+        last = {.iter = iter + 1, .moved = moved, .inertia = static_cast<double>(c_buff.inertia), .seconds = 0.0};
+        if (k_means::should_checkpoint(run, last.iter)){
+            k_means::save_checkpoint(run.checkpoint_dir, last, params.rng,
+                [&](const fs::path& dir) { save_state(params, c_buff, dir); });
+        }
+        if (run.verbose){
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            k_means::log_iteration(run.label + "L1 k-means", params.num_pts,
+                {.iter = iter, .moved = moved, .inertia = static_cast<double>(c_buff.inertia), .seconds = seconds});
+        }
+        if (k_means::has_converged(run, moved, params.num_pts)) break;
+    }
+
+    if (stats){
+        last.seconds = chrono::duration<double>(chrono::steady_clock::now() - run_start).count();
+        *stats = last;
     }
 
     return {std::move(c_buff.assignments), std::move(c_buff.centers),};
 }
-}
\ No newline at end of file
+
+template <typename T>
+static vector<T> sample_points(const ClusteringParams& params, size_t sample_pts, span<const T> pts) {
+    //draws with replacement, sorted so that the reads walk pts front to back
+
+    uniform_int_distribution<size_t> pick(0, params.num_pts - 1);
+    vector<size_t> idxs(min(sample_pts, params.num_pts));
+    for (size_t& idx : idxs) idx = pick(params.rng);
+    sort(idxs.begin(), idxs.end());
+
+    vector<T> sample;
+    sample.reserve(idxs.size() * params.dim);
+    for (size_t idx : idxs) {
+        span<const T> pt_span = pts.subspan(idx * params.dim, params.dim);
+        sample.insert(sample.end(), pt_span.begin(), pt_span.end());
+    }
+    return sample;
+}
+
+template <typename T>
+vector<int> streaming_l1_k_means(const ClusteringParams& params, const StreamingParams& stream,
+    span<const T> pts, const AssignmentSink& sink) {
+
+    if (pts.size() != params.dim* params.num_pts) throw runtime_error("pt size doesnt match param specs");
+    if (stream.chunk_pts == 0) throw runtime_error("chunk_pts must be positive");
+    if (min(stream.sample_pts, params.num_pts) < params.num_clusters) throw runtime_error("sample_pts must be at least num_clusters");
+
+    ClusterBuffer c_buff;
+    set_value_range(params, c_buff, pts);
+
+    vector<T> sample = sample_points(params, stream.sample_pts, pts);
+    ClusteringParams sample_params{
+        .num_clusters = params.num_clusters,
+        .num_pts = sample.size() / params.dim,
+        .dim = params.dim,
+        .max_iters = params.max_iters,
+        .rng = std::mt19937{static_cast<uint32_t>(params.rng())},
+    };
+    init_centers<T>(sample_params, c_buff, sample);
+
+    for (size_t iter = 0; iter < params.max_iters; ++iter) {
+
+        vector<int> prev_centers = c_buff.centers;
+        c_buff.counts.assign(params.num_clusters, 0);
+        c_buff.histograms.assign(params.num_clusters * params.dim * c_buff.num_vals, 0);
+
+        #pragma omp parallel
+        {
+            vector<uint64_t> local_hist(c_buff.histograms.size(), 0);
+            vector<size_t> local_counts(params.num_clusters, 0);
+
+            //every thread walks the same chunk at a time, so the reads stay sequential
+            for (size_t begin = 0; begin < params.num_pts; begin += stream.chunk_pts) {
+                size_t end = min(begin + stream.chunk_pts, params.num_pts);
+
+                #pragma omp for schedule(static)
+                for (size_t pt_idx = begin; pt_idx < end; ++pt_idx) {
+                    span<const T> pt_span = pts.subspan(pt_idx * params.dim, params.dim);
+                    int dist;
+                    size_t ctr = static_cast<size_t>(nearest_center(params, c_buff.centers, pt_span, dist));
+                    ++local_counts[ctr];
+                    add_to_histogram(params, c_buff, ctr, pt_span, local_hist);
+                }
+            }
+
+            #pragma omp critical
+            {
+                for (size_t i = 0; i < local_hist.size(); ++i) c_buff.histograms[i] += local_hist[i];
+                for (size_t i = 0; i < local_counts.size(); ++i) c_buff.counts[i] += local_counts[i];
+            }
+        }
+
+        vector<bool> reinit = centers_from_histograms(params, c_buff);
+        if (find(reinit.begin(), reinit.end(), true) != reinit.end()){
+            reinit_centers(params, c_buff, pts, reinit);
+        }
+        if (c_buff.centers == prev_centers) break;
+    }
+
+    vector<int> chunk_assignments;
+    for (size_t begin = 0; begin < params.num_pts; begin += stream.chunk_pts) {
+        size_t end = min(begin + stream.chunk_pts, params.num_pts);
+        chunk_assignments.resize(end - begin);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t pt_idx = begin; pt_idx < end; ++pt_idx) {
+            int dist;
+            chunk_assignments[pt_idx - begin] = nearest_center(params, c_buff.centers, pts.subspan(pt_idx * params.dim, params.dim), dist);
+        }
+        sink(chunk_assignments);
+    }
+
+    return std::move(c_buff.centers);
+}
+
+#define INSTANTIATE_L1_K_MEANS(T) \
+    template void init_centers<T>(const ClusteringParams&, ClusterBuffer&, span<const T>); \
+    template void update_assignments_and_counts<T>(const ClusteringParams&, ClusterBuffer&, span<const T>); \
+    template vector<bool> update_centers<T>(const ClusteringParams&, ClusterBuffer&, span<const T>); \
+    template void reinit_centers<T>(const ClusteringParams&, ClusterBuffer&, span<const T>, const vector<bool>&); \
+    template size_t clustering_step<T>(const ClusteringParams&, ClusterBuffer&, span<const T>); \
+    template pair<vector<int>,vector<int>> l1_k_means<T>(const ClusteringParams&, span<const T>, k_means::IterationStats*); \
+    template vector<int> streaming_l1_k_means<T>(const ClusteringParams&, const StreamingParams&, span<const T>, const AssignmentSink&);
+
+INSTANTIATE_L1_K_MEANS(int)
+INSTANTIATE_L1_K_MEANS(uint8_t)
+
+}
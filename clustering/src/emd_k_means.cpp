@@ -1,12 +1,19 @@
     #include "emd_k_means.h"
+    #include "matrix_loader.h"
+    #include <chrono>
+    #include <optional>
     #include <string>
     #include <algorithm>
     #include <random>
     #include <limits>
     #include <vector>
     #include <span>
+    #include <array>
+    #include <cstdint>
+    #include <cmath>
 
     using namespace std;
+    namespace fs = std::filesystem;
 
 namespace emd{
 
@@ -38,98 +45,206 @@ namespace emd{
     }
 
 
-    float approx_EMD(const Params& params, const Center& ctr, span<const int> multiset,  const EMDCache& emd_cache, EMDScratch& emd_scratch) {
+    void fill_sparse_multiset(const Params& params, span<const uint8_t> histogram, SparseMultiset& sparse){
 
-        if (multiset.size() != params.multiset_size) throw runtime_error("Something got cooked");
+        if (histogram.size() != params.num_verts) throw runtime_error("histogram length does not match num_verts");
 
-        float temp = 1.0f / static_cast<float>(multiset.size());
-        emd_scratch.targets.assign(multiset.size(), temp);
-        emd_scratch.done.assign(multiset.size(), false);
-        emd_scratch.mean_remaining.assign(ctr.wts.begin(), ctr.wts.end());
+        float unit = 1.0f / static_cast<float>(params.multiset_size);
+        sparse.size = 0;
+
+        for (size_t v = 0; v < params.num_verts; ++v){
+            if (histogram[v] == 0) continue;
+            sparse.verts[sparse.size] = static_cast<int>(v);
+            sparse.wts[sparse.size] = static_cast<float>(histogram[v]) * unit;
+            ++sparse.size;
+        }
+    }
+
+    float approx_EMD(const Params& params, const Center& ctr, const SparseMultiset& multiset, const EMDCache& emd_cache, float cutoff) {
+
+        //targets[j] == 0 means all of the mass on the j^th vertex has been moved
+        array<float, max_support> targets;
+        array<float, max_support> mean_remaining;
+        copy(multiset.wts.begin(), multiset.wts.begin() + multiset.size, targets.begin());
+        copy(ctr.wts.begin(), ctr.wts.end(), mean_remaining.begin());
 
         float total_cost = 0;
+        size_t num_open = multiset.size;
 
-        for (size_t i = 0; i < params.center_support; ++i) {
+        for (size_t i = 0; i < params.center_support && num_open > 0; ++i) {
 
-            for (size_t j = 0; j < params.multiset_size; ++j) {
+            for (size_t j = 0; j < multiset.size; ++j) {
 
-                if (emd_scratch.done[j]) continue;
+                if (targets[j] == 0) continue;
 
-                int ground_cluster = multiset[j];
-                size_t oc_idx = ground_cluster * params.center_support + i;
+                size_t oc_idx = static_cast<size_t>(multiset.verts[j]) * params.center_support + i;
                 int mean_cluster = emd_cache.ordered_clusters[oc_idx];
 
-                float amt_rem = emd_scratch.mean_remaining[mean_cluster];
+                float amt_rem = mean_remaining[mean_cluster];
                 if (amt_rem == 0) continue;
 
                 float d = emd_cache.sorted_distances[oc_idx];
 
-                if (amt_rem < emd_scratch.targets[j]) {
+                if (amt_rem < targets[j]) {
                     total_cost += d * amt_rem;
-                    emd_scratch.targets[j] -= amt_rem;
-                    emd_scratch.mean_remaining[mean_cluster] = 0;
+                    targets[j] -= amt_rem;
+                    mean_remaining[mean_cluster] = 0;
                 } 
 
                 else {
-                    total_cost += emd_scratch.targets[j] * d;
-                    emd_scratch.mean_remaining[mean_cluster] -= emd_scratch.targets[j];
-                    emd_scratch.targets[j] = 0;
-                    emd_scratch.done[j] = true;
+                    total_cost += targets[j] * d;
+                    mean_remaining[mean_cluster] -= targets[j];
+                    targets[j] = 0;
+                    --num_open;
                 }
             }
+            if (total_cost > cutoff) break;
         }
         return total_cost;
     }
 
-    void update_assignments_and_counts(const Params& params, ClusterBuffer& c_buff, 
-        const vector<int>& multisets, EMDCache& emd_cache) {
+    vector<int> pick_anchors(const Params& params){
 
-        c_buff.assignments.assign(params.num_multisets, 0);
-        c_buff.min_dists.assign(params.num_multisets, numeric_limits<float>::max());
+        vector<int> anchors;
+        vector<float> dist_to_anchors(params.num_verts, numeric_limits<float>::max());
+        size_t next = 0;
 
-        for (size_t ctr = 0; ctr <c_buff.centers.size(); ++ctr) {
-            fill_emd_cache(params,c_buff.centers[ctr], emd_cache);   
+        while (anchors.size() < min(num_anchors, params.num_verts)){
+            anchors.push_back(static_cast<int>(next));
 
-            #pragma omp parallel
-            {
-                EMDScratch local_scratch;              
-                #pragma omp for schedule(static)
-                for (size_t multiset = 0; multiset < params.num_multisets; ++multiset) {
-                    span<const int> multiset_span(&multisets[multiset * params.multiset_size], params.multiset_size);
-                    float dist = approx_EMD(params, c_buff.centers[ctr], multiset_span, emd_cache, local_scratch);
-                    if (dist < c_buff.min_dists[multiset]) {
-                        c_buff.min_dists[multiset] = dist;
-                        c_buff.assignments[multiset] = static_cast<int>(ctr);
-                    }
+            float farthest = -1;
+            for (size_t v = 0; v < params.num_verts; ++v){
+                dist_to_anchors[v] = min(dist_to_anchors[v], params.weight_matrix[next*params.num_verts + v]);
+                if (dist_to_anchors[v] > farthest){
+                    farthest = dist_to_anchors[v];
+                    next = v;
                 }
             }
         }
+        return anchors;
+    }
 
-        c_buff.counts.assign(params.num_clusters, 0);
-        for (size_t multiset = 0; multiset < params.num_multisets; ++multiset)
-            c_buff.counts[c_buff.assignments[multiset]] += 1;
+    void fill_potentials(const Params& params, const vector<int>& anchors,
+        span<const int> verts, span<const float> wts, Potentials& potentials){
+
+        potentials.fill(0);
+        for (size_t a = 0; a < anchors.size(); ++a){
+            const float* row = &params.weight_matrix[static_cast<size_t>(anchors[a]) * params.num_verts];
+            for (size_t i = 0; i < verts.size(); ++i)
+                potentials[a] += wts[i] * row[verts[i]];
+        }
+    }
+
+    static float potential_gap(const Potentials& a, const Potentials& b){
+        float gap = 0;
+        for (size_t i = 0; i < num_anchors; ++i) gap = max(gap, abs(a[i] - b[i]));
+        return gap;
     }
 
-    void update_grouped(const Params& params, ClusterBuffer& c_buff, const vector<int>& multisets) {
-        // groups multisets by cluster assignment into contiguous blocks in c_buff.grouped
+    void add_to_dense(const Params& params, span<const uint8_t> histogram, vector<int>& dense_rep){
+        for (size_t v = 0; v < params.num_verts; ++v)
+            dense_rep[v] += histogram[v];
+    }
+
+    void fill_emd_caches(const Params& params, const vector<Center>& centers, vector<EMDCache>& emd_caches){
+
+        emd_caches.resize(centers.size());
+
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t ctr = 0; ctr < centers.size(); ++ctr) {
+            fill_emd_cache(params, centers[ctr], emd_caches[ctr]);
+        }
+    }
+
+    static vector<Potentials> center_potentials(const Params& params, const ClusterBuffer& c_buff){
+        vector<Potentials> ctr_potentials(c_buff.centers.size());
+        for (size_t ctr = 0; ctr < c_buff.centers.size(); ++ctr){
+            const Center& center = c_buff.centers[ctr];
+            fill_potentials(params, c_buff.anchors, center.verts, center.wts, ctr_potentials[ctr]);
+        }
+        return ctr_potentials;
+    }
+
+    /// Exact nearest center (lowest index wins ties), skipping centers the anchor bound rules out.
+    /// Starts from first_guess if it is a valid center, otherwise from the center with the smallest bound.
+    static int nearest_center(const Params& params, const ClusterBuffer& c_buff, const vector<EMDCache>& emd_caches,
+        const vector<Potentials>& ctr_potentials, const SparseMultiset& sparse, const Potentials& potentials,
+        int first_guess, float& best_dist){
+
+        const size_t num_centers = c_buff.centers.size();
+
+        if (first_guess < 0 || static_cast<size_t>(first_guess) >= num_centers){
+            float smallest_gap = numeric_limits<float>::max();
+            for (size_t ctr = 0; ctr < num_centers; ++ctr){
+                float gap = potential_gap(potentials, ctr_potentials[ctr]);
+                if (gap < smallest_gap){
+                    smallest_gap = gap;
+                    first_guess = static_cast<int>(ctr);
+                }
+            }
+        }
+
+        best_dist = approx_EMD(params, c_buff.centers[first_guess], sparse, emd_caches[first_guess]);
+        int best_ctr = first_guess;
 
-        vector<size_t> offsets(params.num_clusters, 0);
+        for (size_t ctr = 0; ctr < num_centers; ++ctr) {
+            if (static_cast<int>(ctr) == first_guess) continue;
+            if (potential_gap(potentials, ctr_potentials[ctr]) > best_dist) continue;
 
-        for (size_t ctr = 1; ctr < params.num_clusters; ++ctr) {
-            offsets[ctr] = offsets[ctr-1] + c_buff.counts[ctr-1] * params.multiset_size;
+            float dist = approx_EMD(params, c_buff.centers[ctr], sparse, emd_caches[ctr], best_dist);
+            if (dist < best_dist || (dist == best_dist && static_cast<int>(ctr) < best_ctr)) {
+                best_dist = dist;
+                best_ctr = static_cast<int>(ctr);
+            }
         }
+        return best_ctr;
+    }
+
+    static void fill_point(const Params& params, const ClusterBuffer& c_buff, span<const uint8_t> histogram,
+        SparseMultiset& sparse, Potentials& potentials){
+
+        fill_sparse_multiset(params, histogram, sparse);
+        fill_potentials(params, c_buff.anchors, span<const int>(sparse.verts.data(), sparse.size),
+            span<const float>(sparse.wts.data(), sparse.size), potentials);
+    }
 
-        c_buff.grouped.resize(params.num_multisets * params.multiset_size);
+    void update_assignments_and_counts(const Params& params, ClusterBuffer& c_buff, 
+        span<const uint8_t> multisets, vector<EMDCache>& emd_caches) {
+
+        c_buff.assignments.assign(params.num_multisets, 0);
+        c_buff.min_dists.assign(params.num_multisets, numeric_limits<float>::max());
 
-        for (size_t multiset = 0; multiset < params.num_multisets; ++multiset) {
-            int ass_ctr = c_buff.assignments[multiset];
-            size_t gpd_idx = offsets[ass_ctr];
-            size_t multisets_idx = multiset * params.multiset_size;
-            for (size_t i = 0; i < params.multiset_size; ++i) {
-                c_buff.grouped[gpd_idx + i] = multisets[multisets_idx + i];
+        fill_emd_caches(params, c_buff.centers, emd_caches);
+        vector<Potentials> ctr_potentials = center_potentials(params, c_buff);
+
+        size_t moved = 0;
+        double inertia = 0.0;
+
+        //one pass over the multisets: each one is compared against every center while it is still in cache
+        #pragma omp parallel
+        {
+            SparseMultiset sparse;
+            Potentials potentials;
+            #pragma omp for schedule(dynamic, 256) reduction(+:moved, inertia)
+            for (size_t multiset = 0; multiset < params.num_multisets; ++multiset) {
+                fill_point(params, c_buff, multisets.subspan(multiset * params.num_verts, params.num_verts), sparse, potentials);
+
+                //starting from last iteration's center gives a tight bound straight away
+                int prev = c_buff.prev_assignments.empty() ? -1 : c_buff.prev_assignments[multiset];
+                float best_dist;
+                c_buff.assignments[multiset] = nearest_center(params, c_buff, emd_caches, ctr_potentials,
+                    sparse, potentials, prev, best_dist);
+                c_buff.min_dists[multiset] = best_dist;
+                moved += (c_buff.assignments[multiset] != prev);
+                inertia += best_dist;
             }
-            offsets[ass_ctr] += params.multiset_size;
-        }   
+        }
+        c_buff.num_moved = moved;
+        c_buff.inertia = inertia;
+
+        c_buff.counts.assign(params.num_clusters, 0);
+        for (size_t multiset = 0; multiset < params.num_multisets; ++multiset)
+            c_buff.counts[c_buff.assignments[multiset]] += 1;
     }
 
     void clipped_dense_center(const Params& params, Center& ctr, const vector<int>& dense_rep){
@@ -155,42 +270,54 @@ namespace emd{
 
     }
 
-    vector<bool> update_centers(const Params& params, ClusterBuffer& c_buff) {
-        
+    static vector<bool> centers_from_dense_reps(const Params& params, ClusterBuffer& c_buff) {
 
         vector<bool> reinit(c_buff.counts.size());
-        size_t running = 0;
-
         vector<int> dense_rep(params.num_verts);
 
         for (size_t ctr = 0; ctr <c_buff.centers.size(); ++ctr){
 
-            dense_rep.assign(params.num_verts, 0);
-
             if (c_buff.counts[ctr] == 0){
                 reinit[ctr] = true;
                 continue;
             } 
 
-            size_t end = running + c_buff.counts[ctr]*params.multiset_size;
+            auto row = c_buff.dense_reps.begin() + ctr * params.num_verts;
+            dense_rep.assign(row, row + params.num_verts);
+            clipped_dense_center(params, c_buff.centers[ctr], dense_rep);
+        }
+        return reinit;
+    }
+
+    vector<bool> update_centers(const Params& params, ClusterBuffer& c_buff, span<const uint8_t> multisets) {
+
+        c_buff.dense_reps.assign(params.num_clusters * params.num_verts, 0);
+
+        #pragma omp parallel
+        {
+            vector<int> local(c_buff.dense_reps.size(), 0);
 
-            for (size_t i = running; i < end; ++i){
-                dense_rep[c_buff.grouped[i]] += 1;
+            #pragma omp for schedule(static) nowait
+            for (size_t multiset = 0; multiset < params.num_multisets; ++multiset) {
+                size_t row = static_cast<size_t>(c_buff.assignments[multiset]) * params.num_verts;
+                for (size_t v = 0; v < params.num_verts; ++v)
+                    local[row + v] += multisets[multiset * params.num_verts + v];
             }
 
-            running = end;
-            clipped_dense_center(params, c_buff.centers[ctr], dense_rep);
+            #pragma omp critical
+            for (size_t i = 0; i < local.size(); ++i) c_buff.dense_reps[i] += local[i];
         }
-        return reinit;
+
+        return centers_from_dense_reps(params, c_buff);
     }
 
 
     void reinit_centers(const Params& params, ClusterBuffer& c_buff,
-        const vector<int>& multisets, const vector<bool>& reinit) {
+        span<const uint8_t> multisets, const vector<bool>& reinit) {
 
         //fully randomized reinitialize. Should prolly do better at some point
         std::vector<int> dense_rep;
-        size_t num_multisets = multisets.size() / params.multiset_size;  
+        size_t num_multisets = multisets.size() / params.num_verts;  
         uniform_int_distribution<size_t> pick(0, num_multisets - 1);
 
         for (size_t ctr = 0; ctr < params.num_clusters; ++ctr) { 
@@ -204,14 +331,13 @@ namespace emd{
 
 
             dense_rep.assign(params.num_verts, 0);
-            for (size_t j = 0; j < params.multiset_size; ++j)
-                dense_rep[multisets[multiset * params.multiset_size + j]] += 1;
+            add_to_dense(params, multisets.subspan(multiset * params.num_verts, params.num_verts), dense_rep);
             clipped_dense_center(params, c_buff.centers[ctr], dense_rep);
         }
     }  
 
     void init_centers(const Params& params, ClusterBuffer& c_buff,
-        const vector<int>&multisets, EMDCache& emd_cache){
+        span<const uint8_t> multisets, EMDCache& emd_cache){
         //heuristic initialization ofc_buff.centers 
         
         c_buff.centers.resize(params.num_clusters);
@@ -227,9 +353,7 @@ namespace emd{
         }
 
         dense_rep.assign(params.num_verts, 0);
-        for (size_t j = 0; j < params.multiset_size; ++j){
-            dense_rep[multisets[first_center * params.multiset_size + j]] += 1;
-        }
+        add_to_dense(params, multisets.subspan(first_center * params.num_verts, params.num_verts), dense_rep);
 
         clipped_dense_center(params, c_buff.centers[0], dense_rep);
 
@@ -242,11 +366,12 @@ namespace emd{
             fill_emd_cache(params,c_buff.centers[ctr-1], emd_cache);
             #pragma omp parallel
             {
-                EMDScratch local_scratch;                     
+                SparseMultiset sparse;
                 #pragma omp for reduction(+:total) schedule(static)
                 for (size_t multiset = 0; multiset < params.num_multisets; ++multiset) {
-                    span<const int> multiset_span(&multisets[multiset * params.multiset_size], params.multiset_size);
-                    float dist = approx_EMD(params, c_buff.centers[ctr-1], multiset_span, emd_cache, local_scratch);
+                    span<const uint8_t> histogram = multisets.subspan(multiset * params.num_verts, params.num_verts);
+                    fill_sparse_multiset(params, histogram, sparse);
+                    float dist = approx_EMD(params, c_buff.centers[ctr-1], sparse, emd_cache);
                     dist = dist * dist;
                     if (dist < c_buff.min_dists[multiset]) c_buff.min_dists[multiset] = dist;
                     total += c_buff.min_dists[multiset];
@@ -268,55 +393,253 @@ namespace emd{
             }
             
             dense_rep.assign(params.num_verts, 0);
-            for (size_t j = 0; j < params.multiset_size; ++j){
-                dense_rep[multisets[chosen * params.multiset_size + j]] += 1;
-            }
+            add_to_dense(params, multisets.subspan(chosen * params.num_verts, params.num_verts), dense_rep);
             clipped_dense_center(params, c_buff.centers[ctr], dense_rep);
         }
 
     }
 
 
-    bool clustering_step(const Params& params, ClusterBuffer& c_buff, 
-        const vector<int>& multisets,  EMDCache& emd_cache) {
+    size_t clustering_step(const Params& params, ClusterBuffer& c_buff, 
+        span<const uint8_t> multisets,  vector<EMDCache>& emd_caches) {
 
         c_buff.prev_assignments.swap(c_buff.assignments);   
         
-        update_assignments_and_counts(params, c_buff, multisets, emd_cache); 
-        update_grouped(params, c_buff, multisets);
-        vector<bool> reinit = update_centers(params, c_buff);
+        update_assignments_and_counts(params, c_buff, multisets, emd_caches); 
+        vector<bool> reinit = update_centers(params, c_buff, multisets);
        
         if (find(reinit.begin(), reinit.end(), true) != reinit.end()){
             reinit_centers(params, c_buff, multisets, reinit);
         }
 
-        return c_buff.assignments != c_buff.prev_assignments;
+        return c_buff.num_moved;
+    }
+
+    static void save_state(const Params& params, const ClusterBuffer& c_buff, const fs::path& dir){
+        vector<float> wts;
+        vector<int> verts;
+        for (const Center& ctr : c_buff.centers){
+            wts.insert(wts.end(), ctr.wts.begin(), ctr.wts.end());
+            verts.insert(verts.end(), ctr.verts.begin(), ctr.verts.end());
+        }
+
+        MatrixHeader wts_header{
+            .num_rows = params.num_clusters,
+            .num_cols = params.center_support,
+            .bytes_per_elt = sizeof(float),
+            .is_signed = true,
+            .is_float = true};
+        write_matrix_and_header<float>((dir / "ctrs_wts.npy").string(), wts_header, wts);
+
+        MatrixHeader verts_header{
+            .num_rows = params.num_clusters,
+            .num_cols = params.center_support,
+            .bytes_per_elt = sizeof(int),
+            .is_signed = true,
+            .is_float = false};
+        write_matrix_and_header<int>((dir / "ctrs_verts.npy").string(), verts_header, verts);
+
+        MatrixHeader assignment_header{
+            .num_rows = params.num_multisets,
+            .num_cols = 1,
+            .bytes_per_elt = sizeof(int),
+            .is_signed = true,
+            .is_float = false};
+        write_matrix_and_header<int>((dir / "assignments.npy").string(), assignment_header, c_buff.assignments);
+    }
+
+    static void load_state(const Params& params, ClusterBuffer& c_buff, const fs::path& dir){
+        auto [wts, wts_header] = load_matrix_and_header<float>((dir / "ctrs_wts.npy").string());
+        auto [verts, verts_header] = load_matrix_and_header<int>((dir / "ctrs_verts.npy").string());
+        auto [assignments, assignment_header] = load_matrix_and_header<int>((dir / "assignments.npy").string());
+
+        if (wts_header.num_rows != params.num_clusters || wts_header.num_cols != params.center_support
+            || verts_header.num_rows != params.num_clusters || verts_header.num_cols != params.center_support
+            || assignment_header.num_rows != params.num_multisets){
+            throw runtime_error("checkpoint does not match params: " + dir.string());
+        }
+
+        c_buff.centers.resize(params.num_clusters);
+        for (size_t ctr = 0; ctr < params.num_clusters; ++ctr){
+            auto first = ctr * params.center_support;
+            c_buff.centers[ctr].wts.assign(wts.begin() + first, wts.begin() + first + params.center_support);
+            c_buff.centers[ctr].verts.assign(verts.begin() + first, verts.begin() + first + params.center_support);
+        }
+        c_buff.assignments = std::move(assignments);
     }
 
-    pair<vector<int>, vector<Center>> emd_k_means(const Params& params, const vector<int>& multisets) {
+    pair<vector<int>, vector<Center>> emd_k_means(const Params& params, span<const uint8_t> multisets, k_means::IterationStats* stats) {
     
 
-        if (multisets.size() != params.multiset_size*params.num_multisets){
+        if (multisets.size() != params.num_verts*params.num_multisets){
             throw runtime_error("multiset size does not match params");
         }
+        if (params.center_support > max_support || min(params.num_verts, params.multiset_size) > max_support){
+            throw runtime_error("center_support and distinct vertices per multiset must be at most " + to_string(max_support));
+        }
 
         ClusterBuffer c_buff;
         c_buff.assignments.assign(params.num_multisets, 0);
         c_buff.prev_assignments.assign(params.num_multisets, -1);
         c_buff.min_dists.assign(params.num_multisets, 0.0);
-        c_buff.grouped.assign(params.num_multisets*params.multiset_size, 0);
         c_buff.counts.assign(params.num_clusters, 0);
 
-        EMDCache emd_cache;
-        EMDScratch emd_scratch;
+        // one cache per center so the assignment step can compare each multiset against all centers at once
+        vector<EMDCache> emd_caches(params.num_clusters);
+        c_buff.anchors = pick_anchors(params);
 
-        init_centers(params, c_buff, multisets,emd_cache);
+        const k_means::RunOptions& run = params.run;
+        size_t first_iter = 0;
+        optional<k_means::IterationStats> resumed;
+        if (!run.checkpoint_dir.empty()){
+            resumed = k_means::load_checkpoint(run.checkpoint_dir, params.rng,
+                [&](const fs::path& dir) { load_state(params, c_buff, dir); });
+        }
+        if (!resumed) init_centers(params, c_buff, multisets, emd_caches[0]);
+        else if (k_means::has_converged(run, resumed->moved, params.num_multisets)) first_iter = params.max_iters; // it had already stopped
+        else first_iter = resumed->iter;
 
-        for (size_t iter = 0; iter < params.max_iters; ++iter) {
-            bool changed = clustering_step(params, c_buff, multisets, emd_cache);   
-            if (!changed) break;    
+        chrono::steady_clock::time_point run_start = chrono::steady_clock::now();
+        k_means::IterationStats last = resumed.value_or(k_means::IterationStats{.iter = 0, .moved = 0, .inertia = 0.0, .seconds = 0.0});
+
+        for (size_t iter = first_iter; iter < params.max_iters; ++iter) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            size_t moved = clustering_step(params, c_buff, multisets, emd_caches);
+
+            last = {.iter = iter + 1, .moved = moved, .inertia = static_cast<double>(c_buff.inertia), .seconds = 0.0};
+            if (k_means::should_checkpoint(run, last.iter)){
+                k_means::save_checkpoint(run.checkpoint_dir, last, params.rng,
+                    [&](const fs::path& dir) { save_state(params, c_buff, dir); });
+            }
+            if (run.verbose){
+                double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                k_means::log_iteration(run.label + "EMD k-means", params.num_multisets,
+                    {.iter = iter, .moved = moved, .inertia = c_buff.inertia, .seconds = seconds});
+            }
+            if (k_means::has_converged(run, moved, params.num_multisets)) break;
+        }
+
+        if (stats){
+            last.seconds = chrono::duration<double>(chrono::steady_clock::now() - run_start).count();
+            *stats = last;
         }
 
         return {std::move(c_buff.assignments), std::move(c_buff.centers)};
     }
+
+    static vector<uint8_t> sample_multisets(const Params& params, size_t sample_multisets, span<const uint8_t> multisets){
+        //draws with replacement, sorted so that the reads walk multisets front to back
+
+        uniform_int_distribution<size_t> pick(0, params.num_multisets - 1);
+        vector<size_t> idxs(min(sample_multisets, params.num_multisets));
+        for (size_t& idx : idxs) idx = pick(params.rng);
+        sort(idxs.begin(), idxs.end());
+
+        vector<uint8_t> sample;
+        sample.reserve(idxs.size() * params.num_verts);
+        for (size_t idx : idxs) {
+            span<const uint8_t> histogram = multisets.subspan(idx * params.num_verts, params.num_verts);
+            sample.insert(sample.end(), histogram.begin(), histogram.end());
+        }
+        return sample;
+    }
+
+    vector<Center> streaming_emd_k_means(const Params& params, const StreamingParams& stream,
+        span<const uint8_t> multisets, const AssignmentSink& sink) {
+
+        if (multisets.size() != params.num_verts*params.num_multisets){
+            throw runtime_error("multiset size does not match params");
+        }
+        if (params.center_support > max_support || min(params.num_verts, params.multiset_size) > max_support){
+            throw runtime_error("center_support and distinct vertices per multiset must be at most " + to_string(max_support));
+        }
+        if (stream.chunk_multisets == 0) throw runtime_error("chunk_multisets must be positive");
+        if (min(stream.sample_multisets, params.num_multisets) < params.num_clusters){
+            throw runtime_error("sample_multisets must be at least num_clusters");
+        }
+
+        ClusterBuffer c_buff;
+        vector<EMDCache> emd_caches(params.num_clusters);
+        c_buff.anchors = pick_anchors(params);
+
+        vector<uint8_t> sample = sample_multisets(params, stream.sample_multisets, multisets);
+        Params sample_params = params;
+        sample_params.num_multisets = sample.size() / params.num_verts;
+        sample_params.rng = std::mt19937{static_cast<uint32_t>(params.rng())};
+        init_centers(sample_params, c_buff, sample, emd_caches[0]);
+
+        for (size_t iter = 0; iter < params.max_iters; ++iter) {
+
+            vector<Center> prev_centers = c_buff.centers;
+            fill_emd_caches(params, c_buff.centers, emd_caches);
+            vector<Potentials> ctr_potentials = center_potentials(params, c_buff);
+
+            c_buff.counts.assign(params.num_clusters, 0);
+            c_buff.dense_reps.assign(params.num_clusters * params.num_verts, 0);
+
+            #pragma omp parallel
+            {
+                SparseMultiset sparse;
+                Potentials potentials;
+                vector<int> local_dense(c_buff.dense_reps.size(), 0);
+                vector<size_t> local_counts(params.num_clusters, 0);
+
+                //every thread walks the same chunk at a time, so the reads stay sequential
+                for (size_t begin = 0; begin < params.num_multisets; begin += stream.chunk_multisets) {
+                    size_t end = min(begin + stream.chunk_multisets, params.num_multisets);
+
+                    #pragma omp for schedule(dynamic, 256)
+                    for (size_t multiset = begin; multiset < end; ++multiset) {
+                        span<const uint8_t> histogram = multisets.subspan(multiset * params.num_verts, params.num_verts);
+                        fill_point(params, c_buff, histogram, sparse, potentials);
+
+                        float best_dist;
+                        size_t ctr = static_cast<size_t>(nearest_center(params, c_buff, emd_caches, ctr_potentials,
+                            sparse, potentials, -1, best_dist));
+
+                        ++local_counts[ctr];
+                        for (size_t v = 0; v < params.num_verts; ++v)
+                            local_dense[ctr * params.num_verts + v] += histogram[v];
+                    }
+                }
+
+                #pragma omp critical
+                {
+                    for (size_t i = 0; i < local_dense.size(); ++i) c_buff.dense_reps[i] += local_dense[i];
+                    for (size_t i = 0; i < local_counts.size(); ++i) c_buff.counts[i] += local_counts[i];
+                }
+            }
+
+            vector<bool> reinit = centers_from_dense_reps(params, c_buff);
+            if (find(reinit.begin(), reinit.end(), true) != reinit.end()){
+                reinit_centers(params, c_buff, multisets, reinit);
+            }
+            if (c_buff.centers == prev_centers) break;
+        }
+
+        fill_emd_caches(params, c_buff.centers, emd_caches);
+        vector<Potentials> ctr_potentials = center_potentials(params, c_buff);
+        vector<int> chunk_assignments;
+
+        for (size_t begin = 0; begin < params.num_multisets; begin += stream.chunk_multisets) {
+            size_t end = min(begin + stream.chunk_multisets, params.num_multisets);
+            chunk_assignments.resize(end - begin);
+
+            #pragma omp parallel
+            {
+                SparseMultiset sparse;
+                Potentials potentials;
+                #pragma omp for schedule(dynamic, 256)
+                for (size_t multiset = begin; multiset < end; ++multiset) {
+                    fill_point(params, c_buff, multisets.subspan(multiset * params.num_verts, params.num_verts), sparse, potentials);
+                    float best_dist;
+                    chunk_assignments[multiset - begin] = nearest_center(params, c_buff, emd_caches, ctr_potentials,
+                        sparse, potentials, -1, best_dist);
+                }
+            }
+            sink(chunk_assignments);
+        }
+
+        return std::move(c_buff.centers);
+    }
 }
@@ -2,80 +2,65 @@
 #include "matrix_loader.h"
 #include "emd_k_means.h"
 #include "indexer.h"
+#include <algorithm>
+#include <omp.h>
 #include <cstdint>
+#include <optional>
 #include <random>
+#include <tuple>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace fs = std::filesystem;
 
-void get_flop_multiset(const std::array<uint8_t, 5>& cards, const std::vector<int>& assignments,
-    hand_indexer_t& turn_indexer, std::array<bool, 52>& missing, std::vector<int>& multiset) {
+// one turn card per remaining card in the deck
+const size_t flop_multiset_size = 47;
 
-    const int deck_size = 52;
-    multiset.assign(deck_size - cards.size(), 0);
+void get_flop_multiset(const uint8_t* cards, const std::vector<int>& assignments,
+    const NextCardIndexer& turn_indexer, std::array<hand_index_t, 52>& turns, std::vector<uint8_t>& multiset) {
+    //multiset is a histogram over the turn clusters, so it must already have one entry per turn cluster
 
-    // sim_turn must stay uint8_t for the hand indexer
-    std::array<uint8_t, 6> sim_turn;
-    for (size_t i = 0; i < cards.size(); ++i)
-        sim_turn[i] = cards[i];
+    std::fill(multiset.begin(), multiset.end(), 0);
 
-    missing.fill(false);
-    for (uint8_t card : cards)
-        missing[card] = true;
-
-    int count = 0;
-    for (uint8_t c1 = 0; c1 < deck_size; ++c1) {
-        if (missing[c1]) continue;
-        sim_turn[5] = c1;
-        hand_index_t idx = hand_index_last(&turn_indexer, sim_turn.data());
-        multiset[count] = assignments[idx];
-        count += 1;
-    }
+    size_t num_turns = turn_indexer.index_children(cards, turns);
+    for (size_t t = 0; t < num_turns; ++t)
+        ++multiset[assignments[turns[t]]];
 }
 
-void run_flop_multisets(const ClusteringConfig& cfg) {
-    if (fs::exists(cfg.art.flop_multisets))
-        throw std::runtime_error("write path already exists: " + cfg.art.flop_multisets.string());
-
-    auto [assignments, header] = load_matrix_and_header<int>(cfg.art.turn_assignments.string());
-
-    std::array<uint8_t, 2> turn_cpr = {2, 4};
-    Indexer turn_indexer(turn_cpr.size(), turn_cpr.data());
+void write_flop_centers(const ClusteringConfig& cfg, const std::vector<emd::Center>& ctrs) {
+    std::vector<float> wts;
+    std::vector<int> verts;
+    wts.reserve(ctrs.size() * cfg.flop_center_support);
+    verts.reserve(ctrs.size() * cfg.flop_center_support);
 
-    std::array<uint8_t, 2> flop_cpr = {2, 3};
-    Indexer flop_indexer(flop_cpr.size(), flop_cpr.data());
+    for (const emd::Center& ctr : ctrs) {
+        for (size_t i = 0; i < ctr.verts.size(); ++i) {
+            wts.push_back(ctr.wts[i]);
+            verts.push_back(static_cast<int>(ctr.verts[i]));
+        }
+    }
 
-    const uint64_t total_flops = static_cast<uint64_t>(hand_indexer_size(&flop_indexer.h, 1));
-    const uint64_t multiset_size = 47;  // one turn card per remaining card in the deck
+    MatrixHeader wts_header{
+        .num_rows = cfg.flop_clusters, 
+        .num_cols = cfg.flop_center_support, 
+        .bytes_per_elt = sizeof(float),
+        .is_signed = true,
+        .is_float = true};
 
-    std::ofstream out(cfg.art.flop_multisets, std::ios::binary);
-    if (!out) throw std::runtime_error("cant open the path: " + cfg.art.flop_multisets.string());
+    write_matrix_and_header<float>(cfg.art.flop_ctrs_wts.string(), wts_header, wts);
 
-    MatrixHeader flop_header{
-        .num_rows = total_flops,
-        .num_cols = multiset_size, 
+    MatrixHeader verts_header{
+        .num_rows = cfg.flop_clusters, 
+        .num_cols = cfg.flop_center_support,
         .bytes_per_elt = sizeof(int),
         .is_signed = true,
         .is_float = false
-    };
-
-    out.write(reinterpret_cast<const char*>(&flop_header), sizeof(flop_header));
-
-    std::array<bool, 52> missing;
-    std::vector<int> multiset(multiset_size);
-    std::array<uint8_t, 5> cards;
-
-    for (uint64_t i = 0; i < total_flops; ++i) {
-        hand_unindex(&flop_indexer.h, 1, i, cards.data());
-        get_flop_multiset(cards, assignments, turn_indexer.h, missing, multiset);
-        out.write(reinterpret_cast<const char*>(multiset.data()), multiset.size() * sizeof(int));
-    }
-
-    out.flush();
-    if (!out) throw std::runtime_error("write failed: " + cfg.art.flop_multisets.string());
+        };
+    write_matrix_and_header<int>(cfg.art.flop_ctrs_verts.string(), verts_header, verts);
 }
 
-
 void run_flop_clusters(const ClusteringConfig& cfg) {
 
     if (fs::exists(cfg.art.flop_ctrs_wts))
@@ -85,60 +70,82 @@ void run_flop_clusters(const ClusteringConfig& cfg) {
     if (fs::exists(cfg.art.flop_assignments))
         throw std::runtime_error("write path already exists: " + cfg.art.flop_assignments.string());
 
-    auto [multisets, multisets_header] = load_matrix_and_header<int>(cfg.art.flop_multisets.string());
+    //the multisets are only mapped when streaming, so they are never fully resident
+    std::vector<uint8_t> loaded;
+    MatrixHeader multisets_header;
+    std::span<const uint8_t> multisets;
+    std::optional<MappedMatrix<uint8_t>> mapped;
+
+    if (cfg.streaming) {
+        mapped.emplace(cfg.art.flop_multisets.string());
+        multisets_header = mapped->get_header();
+        multisets = mapped->data();
+    } else {
+        std::tie(loaded, multisets_header) = load_matrix_and_header<uint8_t>(cfg.art.flop_multisets.string());
+        multisets = loaded;
+    }
+
     auto [dist_matrix, dist_header] = load_matrix_and_header<int>(cfg.art.turn_distance_matrix.string());
+    if (multisets_header.num_cols != dist_header.num_rows)
+        throw std::runtime_error("flop_multisets shape does not match turn_distance_matrix: " + multisets_header.to_string());
 
     emd::Params params{
         .num_clusters = cfg.flop_clusters,
         .num_verts = static_cast<size_t>(dist_header.num_rows),
         .center_support = cfg.flop_center_support,
-        .multiset_size = static_cast<size_t>(multisets_header.num_cols),
+        .multiset_size = flop_multiset_size,
         .num_multisets = static_cast<size_t>(multisets_header.num_rows),
         .weight_matrix = std::vector<float>(dist_matrix.begin(), dist_matrix.end()),
         .max_iters = cfg.flop_max_iters,
         .rng = std::mt19937{cfg.seed},
+        .run = {
+            .min_moved_frac = cfg.min_moved_frac,
+            .checkpoint_dir = stage_checkpoint_dir(cfg.art, "flop"),
+            .checkpoint_every = cfg.art.checkpoint_every,
+            .verbose = true,
+            .label = "",
+        },
     };
 
+    MatrixHeader assignment_header{
+        .num_rows = multisets_header.num_rows, 
+        .num_cols = 1,
+        .bytes_per_elt = sizeof(int),
+        .is_signed = true,
+        .is_float = false};
 
-    auto [assignments, ctrs] = emd::emd_k_means(params, multisets);
+    if (cfg.streaming) {
+        MatrixWriter<int> assignments(cfg.art.flop_assignments.string(), assignment_header);
+        emd::StreamingParams stream{.chunk_multisets = cfg.stream_chunk_pts, .sample_multisets = cfg.stream_sample_pts};
 
-    std::vector<float> wts;
-    std::vector<int> verts;
-    wts.reserve(ctrs.size() * cfg.flop_center_support);
-    verts.reserve(ctrs.size() * cfg.flop_center_support);
+        std::vector<emd::Center> ctrs = emd::streaming_emd_k_means(params, stream, multisets,
+            [&](std::span<const int> chunk) { assignments.append(chunk); });
+        assignments.finish();
 
-    for (const emd::Center& ctr : ctrs) {
-        for (size_t i = 0; i < ctr.verts.size(); ++i) {
-            wts.push_back(ctr.wts[i]);
-            verts.push_back(static_cast<int>(ctr.verts[i]));
-        }
+        write_flop_centers(cfg, ctrs);
+        return;
     }
 
-    MatrixHeader wts_header{
-        .num_rows = cfg.flop_clusters, 
-        .num_cols = cfg.flop_center_support, 
-        .bytes_per_elt = sizeof(float),
-        .is_signed = true,
-        .is_float = true};
+    std::vector<uint32_t> seeds(cfg.restarts);
+    std::vector<std::pair<std::vector<int>, std::vector<emd::Center>>> results(cfg.restarts);
+    std::vector<k_means::IterationStats> stats(cfg.restarts);
 
-    write_matrix_and_header<float>(cfg.art.flop_ctrs_wts.string(), wts_header, wts);
+    k_means::run_restarts(cfg.restarts, [&](size_t restart) {
+        seeds[restart] = cfg.seed + static_cast<uint32_t>(restart);
+        std::string seed_name = "seed_" + std::to_string(seeds[restart]);
 
-    MatrixHeader verts_header{
-        .num_rows = cfg.flop_clusters, 
-        .num_cols = cfg.flop_center_support,
-        .bytes_per_elt = sizeof(int),
-        .is_signed = true,
-        .is_float = false
-        };
-    write_matrix_and_header<int>(cfg.art.flop_ctrs_verts.string(), verts_header, verts);
+        emd::Params restart_params = params;
+        restart_params.rng = std::mt19937{seeds[restart]};
+        if (!params.run.checkpoint_dir.empty()) restart_params.run.checkpoint_dir = params.run.checkpoint_dir / seed_name;
+        if (cfg.restarts > 1) restart_params.run.label = "[" + seed_name + "] ";
 
-    MatrixHeader assignment_header{
-        .num_rows = assignments.size(), 
-        .num_cols = 1,
-        .bytes_per_elt = sizeof(int),
-        .is_signed = true,
-        .is_float = false};
+        results[restart] = emd::emd_k_means(restart_params, multisets, &stats[restart]);
+    });
+
+    size_t best = k_means::best_restart("Flop clustering", seeds, stats);
+    auto& [assignments, ctrs] = results[best];
 
+    write_flop_centers(cfg, ctrs);
     write_matrix_and_header<int>(cfg.art.flop_assignments.string(), assignment_header, assignments);
 }
 
@@ -153,7 +160,7 @@ void cdfs_to_pdfs(size_t num_centers, size_t num_buckets, std::vector<int>& cdfs
     }
 }
 
-std::pair<int, int> get_ev_and_sdev(size_t num_buckets, std::vector<int>& multiset,
+std::pair<int, int> get_ev_and_sdev(size_t num_buckets, std::span<const uint8_t> multiset,
                                const std::vector<int>& centers, std::vector<float>& buff) {
 
     buff.resize(num_buckets);
@@ -161,15 +168,17 @@ std::pair<int, int> get_ev_and_sdev(size_t num_buckets, std::vector<int>& multis
 
     //num buckets is the number of buckets over which we chop up the [0,100] strength interval.
     //Bucket sizes are uniform.
-    //the multiset is a sparse representation of a distribution over the centers
+    //the multiset is a histogram over the centers: multiset[c] = number of turns landing in center c
     //Aggregate the distribution over turns into just a distributino over strengths
 
     float total = 0.0;
-    for (int c : multiset) {
-        size_t ctr_idx = static_cast<size_t>(c) * num_buckets;
+    for (size_t c = 0; c < multiset.size(); ++c) {
+        if (multiset[c] == 0) continue;
+        float count = static_cast<float>(multiset[c]);
+        size_t ctr_idx = c * num_buckets;
         for (size_t i = 0; i < num_buckets; ++i) {
-            buff[i] += static_cast<float>(centers[ctr_idx + i]);
-            total += static_cast<float>(centers[ctr_idx + i]);
+            buff[i] += count * static_cast<float>(centers[ctr_idx + i]);
+            total += count * static_cast<float>(centers[ctr_idx + i]);
         }
     }
 
@@ -191,13 +200,19 @@ std::pair<int, int> get_ev_and_sdev(size_t num_buckets, std::vector<int>& multis
     return output;
 }
 
-void run_flop_ev_sdev(const ClusteringConfig& cfg) {
+void run_flop_features(const ClusteringConfig& cfg) {
+    //one parallel sweep over the flops writes both the multisets and their ev and sdev, chunk by chunk
 
+    if (fs::exists(cfg.art.flop_multisets))
+        throw std::runtime_error("write path already exists: " + cfg.art.flop_multisets.string());
     if (fs::exists(cfg.art.flop_ev_sdev))
         throw std::runtime_error("write path already exists: " + cfg.art.flop_ev_sdev.string());
 
     const size_t num_centers = cfg.turn_clusters;
     const size_t num_buckets = cfg.turn_buckets;
+    const size_t chunk_flops = 1 << 16;
+
+    auto [assignments, assignments_header] = load_matrix_and_header<int>(cfg.art.turn_assignments.string());
 
     auto [centers, centers_header] = load_matrix_and_header<int>(cfg.art.turn_cdf_centers.string());
     if (centers_header.num_rows != num_centers || centers_header.num_cols != num_buckets)
@@ -205,32 +220,66 @@ void run_flop_ev_sdev(const ClusteringConfig& cfg) {
 
     cdfs_to_pdfs(num_centers, num_buckets, centers);
 
-    auto [multisets, multisets_header] = load_matrix_and_header<int>(cfg.art.flop_multisets.string());
-    size_t num_flops = static_cast<size_t>(multisets_header.num_rows);
-    size_t multiset_size = static_cast<size_t>(multisets_header.num_cols);
+    std::array<uint8_t, 2> turn_cpr = {2, 4};
+    Indexer turn_indexer(turn_cpr.size(), turn_cpr.data());
 
-    std::vector<int> multiset_buff(multiset_size, 0);
-    std::vector<float> prob_buff(num_buckets, 0.0);
-    std::vector<int> output(2 * num_flops, 0);
+    std::array<uint8_t, 2> flop_cpr = {2, 3};
+    Indexer flop_indexer(flop_cpr.size(), flop_cpr.data());
 
-    for (size_t i = 0; i < num_flops; ++i) {
-        size_t idx = multiset_size * i;
-        for (size_t j = 0; j < multiset_size; ++j) {
-            multiset_buff[j] = multisets[idx + j];
-        }
+    const uint64_t total_flops = static_cast<uint64_t>(hand_indexer_size(&flop_indexer.h, 1));
+    NextCardIndexer turn_children(turn_indexer);
 
-        auto [ev, sdev] = get_ev_and_sdev(num_buckets, multiset_buff, centers, prob_buff);
-        size_t o_idx = 2 * i;
-        output[o_idx] = ev;
-        output[o_idx + 1] = sdev;
-    }
+    MatrixHeader multisets_header{
+        .num_rows = total_flops,
+        .num_cols = num_centers, 
+        .bytes_per_elt = sizeof(uint8_t),
+        .is_signed = false,
+        .is_float = false
+    };
 
-    MatrixHeader output_header{
-        .num_rows = num_flops,
+    MatrixHeader ev_sdev_header{
+        .num_rows = total_flops,
         .num_cols =  2, 
         .bytes_per_elt = sizeof(int),
         .is_signed = true,
         .is_float = false};
-        
-    write_matrix_and_header<int>(cfg.art.flop_ev_sdev.string(), output_header, output);
-}
\ No newline at end of file
+
+    MatrixWriter<uint8_t> multisets_out(cfg.art.flop_multisets.string(), multisets_header);
+    MatrixWriter<int> ev_sdev_out(cfg.art.flop_ev_sdev.string(), ev_sdev_header);
+
+    std::vector<uint8_t> multisets(chunk_flops * num_centers);
+    std::vector<int> ev_sdev(2 * chunk_flops);
+
+    for (uint64_t begin = 0; begin < total_flops; begin += chunk_flops) {
+        const size_t num_flops = static_cast<size_t>(std::min<uint64_t>(chunk_flops, total_flops - begin));
+
+        #pragma omp parallel
+        {
+            std::array<hand_index_t, 52> turns;
+            std::vector<uint8_t> multiset(num_centers);
+            std::vector<float> prob_buff(num_buckets, 0.0);
+
+            //one contiguous range per thread, so each walks its flops in index order
+            const size_t num_threads = static_cast<size_t>(omp_get_num_threads());
+            const size_t thread = static_cast<size_t>(omp_get_thread_num());
+            const size_t lo = num_flops * thread / num_threads;
+            const size_t hi = num_flops * (thread + 1) / num_threads;
+
+            for (CanonicalHands flops(flop_indexer, 1, begin + lo, begin + hi); flops.next();) {
+                const size_t i = static_cast<size_t>(flops.index() - begin);
+                get_flop_multiset(flops.cards().data(), assignments, turn_children, turns, multiset);
+                std::copy(multiset.begin(), multiset.end(), multisets.begin() + i * num_centers);
+
+                auto [ev, sdev] = get_ev_and_sdev(num_buckets, multiset, centers, prob_buff);
+                ev_sdev[2 * i] = ev;
+                ev_sdev[2 * i + 1] = sdev;
+            }
+        }
+
+        multisets_out.append(std::span<const uint8_t>(multisets.data(), num_flops * num_centers));
+        ev_sdev_out.append(std::span<const int>(ev_sdev.data(), 2 * num_flops));
+    }
+
+    multisets_out.finish();
+    ev_sdev_out.finish();
+}
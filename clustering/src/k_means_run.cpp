@@ -0,0 +1,82 @@
+#include "k_means_run.h"
+#include "perf_counters.h"
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace k_means{
+
+// The state file is written last, so a directory holding one is a complete snapshot.
+static const char* state_file = "state";
+
+static std::mutex log_mutex;
+
+void log_iteration(const std::string& name, size_t num_pts, const IterationStats& stats){
+    double moved_frac = num_pts == 0 ? 0.0 : static_cast<double>(stats.moved) / static_cast<double>(num_pts);
+    std::lock_guard<std::mutex> lock(log_mutex);
+    std::cout << name << " iter " << stats.iter
+        << ": moved " << stats.moved << " (" << 100.0 * moved_frac << "%)"
+        << ", inertia " << stats.inertia
+        << ", " << stats.seconds << " seconds" << std::endl;
+}
+
+void save_checkpoint(const fs::path& dir, const IterationStats& last, const std::mt19937& rng,
+    const std::function<void(const fs::path&)>& write_state){
+
+    PERF_REGION("checkpoint");
+
+    fs::path snapshot = dir / "snapshot";
+    fs::path tmp = dir / "snapshot.tmp";
+
+    fs::remove_all(tmp);
+    fs::create_directories(tmp);
+    write_state(tmp);
+
+    std::ofstream out(tmp / state_file);
+    out.precision(17);
+    out << last.iter << ' ' << last.moved << ' ' << last.inertia << '\n' << rng << std::endl;
+    out.close();
+    if (!out) throw std::runtime_error("write failed: " + (tmp / state_file).string());
+
+    //if this dies between the two calls, load_checkpoint picks up the complete tmp snapshot
+    fs::remove_all(snapshot);
+    fs::rename(tmp, snapshot);
+}
+
+std::optional<IterationStats> load_checkpoint(const fs::path& dir, std::mt19937& rng,
+    const std::function<void(const fs::path&)>& read_state){
+
+    fs::path snapshot = dir / "snapshot";
+    if (!fs::exists(snapshot / state_file)) snapshot = dir / "snapshot.tmp";
+    if (!fs::exists(snapshot / state_file)) return std::nullopt;
+
+    std::ifstream in(snapshot / state_file);
+    IterationStats last{.iter = 0, .moved = 0, .inertia = 0.0, .seconds = 0.0};
+    std::mt19937 saved_rng;
+    if (!(in >> last.iter >> last.moved >> last.inertia >> saved_rng)) throw std::runtime_error("corrupt checkpoint: " + snapshot.string());
+
+    read_state(snapshot);
+    rng = saved_rng;
+    return last;
+}
+
+size_t best_restart(const std::string& name, const std::vector<uint32_t>& seeds, const std::vector<IterationStats>& stats){
+    size_t best = 0;
+    for (size_t r = 0; r < stats.size(); ++r){
+        if (stats[r].inertia < stats[best].inertia) best = r;
+    }
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    for (size_t r = 0; r < stats.size(); ++r){
+        std::cout << name << " seed " << seeds[r]
+            << ": " << stats[r].iter << " iters, inertia " << stats[r].inertia
+            << ", last moved " << stats[r].moved
+            << ", " << stats[r].seconds << " seconds" << (r == best ? " (kept)" : "") << std::endl;
+    }
+    return best;
+}
+
+}
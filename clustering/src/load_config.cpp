@@ -1,5 +1,6 @@
 #include <toml.hpp>
 #include "clustering_config.h"
+#include <stdexcept>
 namespace fs = std::filesystem;
 
 ClusteringConfig load_config(const fs::path& cfg_path, const fs::path& root) {
@@ -17,6 +18,18 @@ ClusteringConfig load_config(const fs::path& cfg_path, const fs::path& root) {
     cfg.flop_max_iters = t["params"]["flop_max_iters"].value<size_t>().value();
     cfg.flop_center_support = t["params"]["flop_center_support"].value<size_t>().value();
 
+    cfg.min_moved_frac = t["params"]["min_moved_frac"].value_or(0.0);
+
+    cfg.restarts = t["params"]["restarts"].value_or<size_t>(1);
+    if (cfg.restarts == 0) throw std::runtime_error("restarts must be at least 1");
+
+    cfg.streaming = t["params"]["streaming"].value_or(false);
+    cfg.stream_chunk_pts = t["params"]["stream_chunk_pts"].value_or<size_t>(1 << 20);
+    cfg.stream_sample_pts = t["params"]["stream_sample_pts"].value_or<size_t>(1000000);
+
+    if (cfg.streaming && cfg.restarts > 1)
+        throw std::runtime_error("restarts need per point distances, which streaming does not keep");
+
     cfg.seed = t["params"]["seed"].value<uint32_t>().value();
 
     cfg.art = Artifacts{
@@ -33,7 +46,9 @@ ClusteringConfig load_config(const fs::path& cfg_path, const fs::path& root) {
         .flop_ctrs_wts = root / t["artifacts"]["flop_ctrs_wts"].value<std::string>().value(),
         .flop_ctrs_verts = root / t["artifacts"]["flop_ctrs_verts"].value<std::string>().value(),
         .flop_assignments = root / t["artifacts"]["flop_assignments"].value<std::string>().value(),
-        .flop_ev_sdev = root / t["artifacts"]["flop_ev_sdev"].value<std::string>().value()
+        .flop_ev_sdev = root / t["artifacts"]["flop_ev_sdev"].value<std::string>().value(),
+        .checkpoints = root / t["artifacts"]["checkpoints"].value_or<std::string>("data/clustering/checkpoints"),
+        .checkpoint_every = t["artifacts"]["checkpoint_every"].value_or<size_t>(0)
     };
 
     return cfg;
@@ -1,43 +1,85 @@
-#include <chrono>
 #include <exception>
 #include <filesystem>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 #include "clustering_config.h"
+#include "matrix_loader.h"
+#include "perf_counters.h"
+#include "stage_graph.h"
 
 namespace fs = std::filesystem;
-using steady = std::chrono::steady_clock;
-using StageFunc = void(*)(const ClusteringConfig&);
-
-void run_stage(StageFunc stage_func, const ClusteringConfig& cfg, const std::string& stage_name) {
-    steady::time_point start_time = steady::now();
-    stage_func(cfg);
-    steady::time_point finish_time = steady::now();
-    std::cout << stage_name << " took "
-        << std::chrono::duration<double>(finish_time - start_time).count()
-        << " seconds" << std::endl;
-    std::cout << "-------------------------------------------------" << std::endl;
+
+std::vector<Stage> clustering_stages(const ClusteringConfig& cfg) {
+    using std::to_string;
+    const Artifacts& art = cfg.art;
+
+    // the k-means checkpoint directory of a stage, if snapshots are on
+    auto checkpoints = [&](const char* stage) {
+        fs::path dir = stage_checkpoint_dir(art, stage);
+        return dir.empty() ? std::vector<fs::path>{} : std::vector<fs::path>{dir};
+    };
+
+    // streaming changes the seeding, so the clusters depend on it
+    std::string stream_params = cfg.streaming
+        ? " streaming chunk=" + to_string(cfg.stream_chunk_pts) + " sample=" + to_string(cfg.stream_sample_pts)
+        : " in_memory";
+
+    std::string stop_params = " min_moved_frac=" + to_string(cfg.min_moved_frac);
+    std::string restart_params = " restarts=" + to_string(cfg.restarts);
+
+    return {
+        {"Generating River Strengths", run_river_strengths,
+            {}, {art.river_strengths}, "dtype=uint8"},
+        {"Clustering River", run_river_clusters,
+            {art.river_strengths}, {art.river_centers, art.river_assignments},
+            "clusters=" + to_string(cfg.river_clusters) + " iters=" + to_string(cfg.river_max_iters)
+                + " seed=" + to_string(cfg.seed) + stop_params,
+            checkpoints("river")},
+        {"Generating Turn CDFs", run_turn_cdfs,
+            {art.river_strengths}, {art.turn_cdfs},
+            "buckets=" + to_string(cfg.turn_buckets) + " dtype=uint8"},
+        {"Clustering Turn", run_turn_clusters,
+            {art.turn_cdfs}, {art.turn_cdf_centers, art.turn_assignments},
+            "clusters=" + to_string(cfg.turn_clusters) + " iters=" + to_string(cfg.turn_max_iters)
+                + " seed=" + to_string(cfg.seed) + stream_params + stop_params + restart_params,
+            checkpoints("turn")},
+        {"Generating Turn Distance Matrix", run_turn_distance_matrix,
+            {art.turn_cdf_centers}, {art.turn_distance_matrix}, ""},
+        {"Generating Flop Multisets, EV and Std Dev", run_flop_features,
+            {art.turn_assignments, art.turn_cdf_centers}, {art.flop_multisets, art.flop_ev_sdev},
+            "turn_clusters=" + to_string(cfg.turn_clusters) + " buckets=" + to_string(cfg.turn_buckets)},
+        {"Clustering Flop", run_flop_clusters,
+            {art.flop_multisets, art.turn_distance_matrix},
+            {art.flop_ctrs_wts, art.flop_ctrs_verts, art.flop_assignments},
+            "clusters=" + to_string(cfg.flop_clusters) + " iters=" + to_string(cfg.flop_max_iters)
+                + " support=" + to_string(cfg.flop_center_support) + " seed=" + to_string(cfg.seed) + stream_params + stop_params + restart_params,
+            checkpoints("flop")},
+    };
 }
 
-int main(int, char** argv) {
+int main(int argc, char** argv) {
     try {
+        // clustering convert <in> <out>: rewrite an existing artifact as .npy (or back to the raw format)
+        if (argc == 4 && std::string(argv[1]) == "convert") {
+            convert_matrix(argv[2], argv[3]);
+            return 0;
+        }
+        if (argc != 1) throw std::runtime_error("usage: clustering [convert <in> <out>]");
+
         fs::path exe  = fs::weakly_canonical(fs::path(argv[0]));
         fs::path root = exe.parent_path().parent_path().parent_path().parent_path();   // repo root
 
         fs::path cfg_path = root / "configs" / "clustering.toml";
         ClusteringConfig cfg = load_config(cfg_path, root);
 
-        run_stage(run_river_strengths,cfg, "Generating River Strengths");
-        run_stage(run_river_clusters, cfg, "Clustering River");
-        run_stage(run_turn_cdfs, cfg, "Generating Turn CDFs");
-        run_stage(run_turn_clusters, cfg, "Clustering Turn");
-        run_stage(run_turn_distance_matrix,cfg, "Generating Turn Distance Matrix");
-        run_stage(run_flop_multisets, cfg, "Generating Flop Multisets");
-        run_stage(run_flop_ev_sdev, cfg, "Generating Flop EV and Std Dev");
-        run_stage(run_flop_clusters, cfg, "Clustering Flop");
+        run_stage_graph(clustering_stages(cfg), cfg);
+        PERF_REPORT(std::cout);
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -60,27 +60,24 @@ void run_river_strengths(const ClusteringConfig& cfg) {
     const uint32_t round = 1;
     const hand_index_t total = hand_indexer_size(&indexer.h, round);
 
-    std::ofstream out(cfg.art.river_strengths, std::ios::binary);
-    if (!out) throw std::runtime_error("cant open the write path: " + cfg.art.river_strengths.string());
-
     MatrixHeader header{
         .num_rows = static_cast<uint64_t>(total),
         .num_cols = 1,
-        .bytes_per_elt = sizeof(int),
-        .is_signed = true,
+        .bytes_per_elt = sizeof(uint8_t),
+        .is_signed = false,
         .is_float = false
     };
     
-    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    MatrixWriter<uint8_t> out(cfg.art.river_strengths.string(), header);
 
     std::array<uint8_t, 7> cards;
     for (hand_index_t i = 0; i < total; ++i) {
         hand_unindex(&indexer.h, round, i, cards.data());
-        int strength = get_strength(cards);
-        out.write(reinterpret_cast<const char*>(&strength), sizeof(strength));
+        uint8_t strength = static_cast<uint8_t>(get_strength(cards));
+        out.append({&strength, 1});
     }
 
-    if (!out) throw std::runtime_error("write failed partway through: " + cfg.art.river_strengths.string());
+    out.finish();
 }
 
 
@@ -90,7 +87,7 @@ void run_river_clusters(const ClusteringConfig& cfg) {
     if (fs::exists(cfg.art.river_assignments))
         throw std::runtime_error("write path already exists: " + cfg.art.river_assignments.string());
     
-    auto [strengths, strength_header] = load_matrix_and_header<int>(cfg.art.river_strengths.string());
+    auto [strengths, strength_header] = load_matrix_and_header<uint8_t>(cfg.art.river_strengths.string());
 
     L1::ClusteringParams params{
         .num_clusters = cfg.river_clusters,
@@ -98,9 +95,16 @@ void run_river_clusters(const ClusteringConfig& cfg) {
         .dim = 1,
         .max_iters = cfg.river_max_iters,
         .rng = std::mt19937{cfg.seed},
+        .run = {
+            .min_moved_frac = cfg.min_moved_frac,
+            .checkpoint_dir = stage_checkpoint_dir(cfg.art, "river"),
+            .checkpoint_every = cfg.art.checkpoint_every,
+            .verbose = true,
+            .label = "",
+        },
     };
 
-    auto [assignments, centers] = L1::l1_k_means(params, strengths);
+    auto [assignments, centers] = L1::l1_k_means<uint8_t>(params, strengths);
 
     MatrixHeader center_header{
         .num_rows = cfg.river_clusters, 
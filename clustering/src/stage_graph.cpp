@@ -0,0 +1,179 @@
+#include "stage_graph.h"
+#include "perf_counters.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using steady = std::chrono::steady_clock;
+
+namespace {
+
+std::mutex print_mutex;
+
+constexpr uint64_t fnv_offset = 14695981039346656037ull;
+constexpr uint64_t fnv_prime = 1099511628211ull;
+
+uint64_t fnv1a(const char* data, size_t num_bytes, uint64_t hash) {
+    for (size_t i = 0; i < num_bytes; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+uint64_t fnv1a(const std::string& str, uint64_t hash) {
+    //hash the terminator too so that concatenations of different strings cant collide
+    return fnv1a(str.c_str(), str.size() + 1, hash);
+}
+
+fs::path meta_path(const fs::path& artifact) {
+    return fs::path(artifact.string() + ".meta");
+}
+
+std::string read_meta(const fs::path& artifact) {
+    std::ifstream in(meta_path(artifact));
+    std::string key;
+    if (!(in >> key)) return "";
+    return key;
+}
+
+std::string content_hash(const fs::path& artifact) {
+    std::ifstream in(artifact, std::ios::binary);
+    if (!in) throw std::runtime_error("missing stage input: " + artifact.string());
+
+    std::vector<char> block(1 << 20);
+    uint64_t hash = fnv_offset;
+    while (in.read(block.data(), block.size()) || in.gcount() > 0)
+        hash = fnv1a(block.data(), static_cast<size_t>(in.gcount()), hash);
+
+    std::ostringstream out;
+    out << "content-" << std::hex << hash;
+    return out.str();
+}
+
+std::string input_key(const fs::path& artifact) {
+    //artifacts produced by a stage are identified by the key of that run, so their contents never need rereading
+    if (!fs::exists(artifact)) throw std::runtime_error("missing stage input: " + artifact.string());
+    std::string key = read_meta(artifact);
+    return key.empty() ? content_hash(artifact) : key;
+}
+
+std::string stage_key(const Stage& stage) {
+    uint64_t hash = fnv1a(stage.name, fnv_offset);
+    hash = fnv1a(stage.params, hash);
+    for (const fs::path& input : stage.inputs)
+        hash = fnv1a(input_key(input), hash);
+
+    std::ostringstream out;
+    out << std::hex << hash;
+    return out.str();
+}
+
+bool is_cached(const Stage& stage, const std::string& key) {
+    for (const fs::path& output : stage.outputs) {
+        if (!fs::exists(output) || read_meta(output) != key) return false;
+    }
+    return true;
+}
+
+void run_stage(const Stage& stage, const ClusteringConfig& cfg) {
+    std::string key = stage_key(stage);
+
+    if (is_cached(stage, key)) {
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::cout << stage.name << " is up to date, skipping" << std::endl;
+        return;
+    }
+
+    //the stages refuse to overwrite, so stale outputs have to go first
+    for (const fs::path& output : stage.outputs) {
+        fs::remove(meta_path(output));
+        fs::remove(output);
+    }
+
+    //an interrupted run with the same key can be resumed, anything else left behind is stale
+    for (const fs::path& dir : stage.scratch) {
+        if (read_meta(dir) != key) fs::remove_all(dir);
+        fs::create_directories(dir.parent_path());
+        std::ofstream out(meta_path(dir));
+        out << key << std::endl;
+        if (!out) throw std::runtime_error("write failed: " + meta_path(dir).string());
+    }
+
+    steady::time_point start_time = steady::now();
+    {
+        PERF_REGION(stage.name); // counts this thread only, not the stage's OpenMP team, see perf_counters.h
+        stage.func(cfg);
+    }
+    steady::time_point finish_time = steady::now();
+
+    //metadata goes last, so an interrupted stage is never mistaken for a finished one
+    for (const fs::path& output : stage.outputs) {
+        std::ofstream out(meta_path(output));
+        out << key << std::endl;
+        if (!out) throw std::runtime_error("write failed: " + meta_path(output).string());
+    }
+    for (const fs::path& dir : stage.scratch) {
+        fs::remove_all(dir);
+        fs::remove(meta_path(dir));
+    }
+
+    std::lock_guard<std::mutex> lock(print_mutex);
+    std::cout << stage.name << " took "
+        << std::chrono::duration<double>(finish_time - start_time).count()
+        << " seconds" << std::endl;
+    std::cout << "-------------------------------------------------" << std::endl;
+}
+
+}
+
+void run_stage_graph(const std::vector<Stage>& stages, const ClusteringConfig& cfg) {
+
+    std::map<fs::path, size_t> producers;
+    std::vector<std::vector<size_t>> deps(stages.size());
+
+    for (size_t s = 0; s < stages.size(); ++s) {
+        for (const fs::path& input : stages[s].inputs) {
+            auto it = producers.find(input);
+            if (it != producers.end()) deps[s].push_back(it->second);
+        }
+        for (const fs::path& output : stages[s].outputs) {
+            if (!producers.emplace(output, s).second)
+                throw std::runtime_error("artifact produced by two stages: " + output.string());
+        }
+    }
+
+    //each stage waits on the futures of its producers, which come before it, so launching in order never deadlocks.
+    //A failed producer rethrows through get(), so its dependents fail without running
+    std::vector<std::shared_future<void>> done(stages.size());
+    for (size_t s = 0; s < stages.size(); ++s) {
+        std::vector<std::shared_future<void>> waits;
+        for (size_t d : deps[s]) waits.push_back(done[d]);
+
+        done[s] = std::async(std::launch::async, [&stages, &cfg, s, waits]() {
+            for (const std::shared_future<void>& wait : waits) wait.get();
+            run_stage(stages[s], cfg);
+        }).share();
+    }
+
+    std::exception_ptr first_error;
+    for (std::shared_future<void>& stage_done : done) {
+        try {
+            stage_done.get();
+        }
+        catch (...) {
+            if (!first_error) first_error = std::current_exception();
+        }
+    }
+    if (first_error) std::rethrow_exception(first_error);
+}
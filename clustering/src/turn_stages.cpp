@@ -8,40 +8,29 @@
 #include <array>
 #include <cstdint>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace fs = std::filesystem;
 
-void get_strength_cdf(const std::array<uint8_t, 6>& cards, uint8_t num_buckets,
-        const std::vector<int>& strengths, hand_indexer_t& river_indexer,
-        std::array<bool, 52>& missing, std::vector<int>& cdf) {
+void get_strength_cdf(const uint8_t* cards, uint8_t num_buckets, const std::vector<uint8_t>& strengths,
+        const NextCardIndexer& river_indexer, std::array<hand_index_t, 52>& rivers, std::vector<uint8_t>& cdf) {
     //fills the cdf vector passed as arg
 
     const int strength_max = 100;
-    const int deck_size = 52;
-
-    std::array<uint8_t, 7> sim_board;
-    for (size_t i = 0; i < cards.size(); ++i)
-        sim_board[i] = cards[i];
-
-    missing.fill(false);
-    for (uint8_t card : cards)
-        missing[card] = true;
 
+    //The cdf is a count over at most 46 rivers, so it fits in uint8_t
     //Note the naming is a bit confusing here: first I use the cdf to store the unnormalized pdf,
     //then later I cumsum to turn it into a (unnormalized) cdf
 
     fill(cdf.begin(), cdf.end(), 0);
 
-    for (uint8_t c1 = 0; c1 < deck_size; ++c1) {
-        if (missing[c1]) continue;
-        sim_board[6] = c1;
-
-        hand_index_t idx = hand_index_last(&river_indexer, sim_board.data());
-        int strength = strengths[idx];
+    size_t num_rivers = river_indexer.index_children(cards, rivers);
+    for (size_t r = 0; r < num_rivers; ++r) {
+        int strength = strengths[rivers[r]];
 
         int bucket = (strength * num_buckets) / (strength_max + 1);
         ++cdf[bucket];
@@ -56,7 +45,7 @@ void run_turn_cdfs(const ClusteringConfig& cfg) {
     if (fs::exists(cfg.art.turn_cdfs))
         throw std::runtime_error("write path already exists: " + cfg.art.turn_cdfs.string());
 
-    auto [strengths, river_header] = load_matrix_and_header<int>(cfg.art.river_strengths.string());
+    auto [strengths, river_header] = load_matrix_and_header<uint8_t>(cfg.art.river_strengths.string());
 
     std::array<uint8_t, 2> river_cpr = {2, 5};
     Indexer river_indexer(river_cpr.size(), river_cpr.data());
@@ -68,40 +57,43 @@ void run_turn_cdfs(const ClusteringConfig& cfg) {
     // so the product cannot overflow uint64_t.
     const hand_index_t total_turns = hand_indexer_size(&turn_indexer.h, 1);
 
-    std::ofstream out(cfg.art.turn_cdfs, std::ios::binary);
-    if (!out) throw std::runtime_error("cant open the path: " + cfg.art.turn_cdfs.string());
-
     MatrixHeader turn_cdf_header{
         .num_rows = static_cast<uint64_t>(total_turns), 
         .num_cols = cfg.turn_buckets,
-        .bytes_per_elt = sizeof(int),
-        .is_signed = true,
+        .bytes_per_elt = sizeof(uint8_t),
+        .is_signed = false,
         .is_float = false
     };
 
-    out.write(reinterpret_cast<const char*>(&turn_cdf_header), sizeof(turn_cdf_header));
+    MatrixWriter<uint8_t> out(cfg.art.turn_cdfs.string(), turn_cdf_header);
 
-    std::array<bool, 52> missing;
-    std::array<uint8_t, 6> cards;
-    std::vector<int> cdf(cfg.turn_buckets);
+    NextCardIndexer river_children(river_indexer);
+    std::array<hand_index_t, 52> rivers;
+    std::vector<uint8_t> cdf(cfg.turn_buckets);
 
-    for (hand_index_t i = 0; i < total_turns; ++i) {
-        hand_unindex(&turn_indexer.h, 1, i, cards.data());
-        get_strength_cdf(cards, cfg.turn_buckets, strengths, river_indexer.h, missing, cdf);
-        out.write(reinterpret_cast<const char*>(cdf.data()), cdf.size() * sizeof(int));
+    for (CanonicalHands turns(turn_indexer, 1, 0, total_turns); turns.next();) {
+        get_strength_cdf(turns.cards().data(), cfg.turn_buckets, strengths, river_children, rivers, cdf);
+        out.append(cdf);
     }
 
-    out.flush();
-    if (!out) throw std::runtime_error("write failed: " + cfg.art.turn_cdfs.string());
+    out.finish();
 }
 
-void run_turn_clusters(const ClusteringConfig& cfg) {
-    if (fs::exists(cfg.art.turn_cdf_centers))
-        throw std::runtime_error("write path already exists: " + cfg.art.turn_cdf_centers.string());
-    if (fs::exists(cfg.art.turn_assignments))
-        throw std::runtime_error("write path already exists: " + cfg.art.turn_assignments.string());
-    
-    auto [cdfs, cdf_header] = load_matrix_and_header<int>(cfg.art.turn_cdfs.string());
+void write_turn_centers(const ClusteringConfig& cfg, uint64_t num_buckets, const std::vector<int>& centers) {
+    MatrixHeader center_header{
+        .num_rows = cfg.turn_clusters, 
+        .num_cols = num_buckets,
+        .bytes_per_elt = sizeof(int),
+        .is_signed = true,
+        .is_float = false
+    };
+
+    write_matrix_and_header<int>(cfg.art.turn_cdf_centers.string(), center_header, centers);
+}
+
+void run_streaming_turn_clusters(const ClusteringConfig& cfg) {
+    MappedMatrix<uint8_t> cdfs(cfg.art.turn_cdfs.string());
+    const MatrixHeader& cdf_header = cdfs.get_header();
 
     L1::ClusteringParams params{
         .num_clusters = cfg.turn_clusters,
@@ -111,17 +103,66 @@ void run_turn_clusters(const ClusteringConfig& cfg) {
         .rng = std::mt19937{cfg.seed},
     };
 
-    auto [assignments, centers] = L1::l1_k_means(params, cdfs);
-
-    MatrixHeader center_header{
-        .num_rows = cfg.turn_clusters, 
-        .num_cols = cdf_header.num_cols,
+    MatrixHeader assignment_header{
+        .num_rows = cdf_header.num_rows,
+        .num_cols = 1, 
         .bytes_per_elt = sizeof(int),
         .is_signed = true,
-        .is_float = false
+        .is_float = false,
     };
 
-    write_matrix_and_header<int>(cfg.art.turn_cdf_centers.string(), center_header, centers);
+    MatrixWriter<int> assignments(cfg.art.turn_assignments.string(), assignment_header);
+    L1::StreamingParams stream{.chunk_pts = cfg.stream_chunk_pts, .sample_pts = cfg.stream_sample_pts};
+
+    std::vector<int> centers = L1::streaming_l1_k_means<uint8_t>(params, stream, cdfs.data(),
+        [&](std::span<const int> chunk) { assignments.append(chunk); });
+    assignments.finish();
+
+    write_turn_centers(cfg, cdf_header.num_cols, centers);
+}
+
+void run_turn_clusters(const ClusteringConfig& cfg) {
+    if (fs::exists(cfg.art.turn_cdf_centers))
+        throw std::runtime_error("write path already exists: " + cfg.art.turn_cdf_centers.string());
+    if (fs::exists(cfg.art.turn_assignments))
+        throw std::runtime_error("write path already exists: " + cfg.art.turn_assignments.string());
+
+    if (cfg.streaming) {
+        run_streaming_turn_clusters(cfg);
+        return;
+    }
+    
+    auto [cdfs, cdf_header] = load_matrix_and_header<uint8_t>(cfg.art.turn_cdfs.string());
+
+    std::vector<uint32_t> seeds(cfg.restarts);
+    std::vector<std::pair<std::vector<int>, std::vector<int>>> results(cfg.restarts);
+    std::vector<k_means::IterationStats> stats(cfg.restarts);
+
+    k_means::run_restarts(cfg.restarts, [&](size_t restart) {
+        seeds[restart] = cfg.seed + static_cast<uint32_t>(restart);
+        std::string seed_name = "seed_" + std::to_string(seeds[restart]);
+
+        L1::ClusteringParams params{
+            .num_clusters = cfg.turn_clusters,
+            .num_pts = static_cast<size_t>(cdf_header.num_rows),
+            .dim = static_cast<size_t>(cdf_header.num_cols),
+            .max_iters = cfg.turn_max_iters,
+            .rng = std::mt19937{seeds[restart]},
+            .run = {
+                .min_moved_frac = cfg.min_moved_frac,
+                .checkpoint_dir = stage_checkpoint_dir(cfg.art, fs::path("turn") / seed_name),
+                .checkpoint_every = cfg.art.checkpoint_every,
+                .verbose = true,
+                .label = cfg.restarts > 1 ? "[" + seed_name + "] " : "",
+            },
+        };
+        results[restart] = L1::l1_k_means<uint8_t>(params, cdfs, &stats[restart]);
+    });
+
+    size_t best = k_means::best_restart("Turn clustering", seeds, stats);
+    auto& [assignments, centers] = results[best];
+
+    write_turn_centers(cfg, cdf_header.num_cols, centers);
 
     MatrixHeader assignment_header{
         .num_rows = assignments.size(),
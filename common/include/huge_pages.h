@@ -0,0 +1,58 @@
+/**
+ * @file huge_pages.h
+ * @brief Huge page backing for the big randomly accessed tables (infoset regrets/strategy and card buckets),
+ * to cut the dTLB misses of the traversal. Set with [memory] huge_pages in configs/train.toml.
+ *
+ * HugeVector<T> is a std::vector whose allocations of 2 MB and up are mmapped directly:
+ *   off     4 KB pages, with madvise(MADV_NOHUGEPAGE) so a THP "always" kernel does not back them with huge pages
+ *   thp     2 MB aligned and madvise(MADV_HUGEPAGE), the kernel backs it with transparent huge pages when it can
+ *   2mb/1gb hugetlbfs pages through mmap(MAP_HUGETLB), these have to be reserved first
+ *           (eg /proc/sys/vm/nr_hugepages). Falls back to the next smaller option with a warning.
+ * Smaller allocations go through operator new. The mode only affects later allocations, so set it before
+ * the tables are built. describe() reports what a table actually got.
+ */
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace huge_pages{
+
+enum class Mode{ off, thp, hugetlb_2mb, hugetlb_1gb };
+
+/// @brief "off", "thp", "2mb" or "1gb"
+/// @throws std::runtime_error on anything else
+Mode parse_mode(const std::string& name);
+std::string to_string(Mode mode);
+
+void set_mode(Mode mode);
+Mode get_mode();
+
+/// @throws std::bad_alloc
+void* allocate(size_t bytes);
+void deallocate(void* p, size_t bytes) noexcept;
+
+/// @brief The pages backing the allocation that starts at p, as /proc/self/smaps reports them, eg "1 GB hugetlb pages"
+/// or "transparent huge pages for 97% of 1.2 GB (transparent huge pages advised)". Call it after the memory was touched.
+std::string describe(const void* p);
+
+}
+
+template <class T>
+struct HugePageAllocator{
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <class U>
+    HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n){ return static_cast<T*>(huge_pages::allocate(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) noexcept { huge_pages::deallocate(p, n * sizeof(T)); }
+
+    template <class U>
+    bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+};
+
+template <class T>
+using HugeVector = std::vector<T, HugePageAllocator<T>>;
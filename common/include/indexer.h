@@ -1,4 +1,6 @@
 #pragma once
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
 extern "C" {
@@ -14,3 +16,73 @@ struct Indexer {
     Indexer(const Indexer&) = delete; 
     Indexer& operator=(const Indexer&) = delete;
 };
+
+/// @brief Walks the canonical hands of one round, in index order, over [begin, end):
+/// for (CanonicalHands hands(indexer, round, 0, size); hands.next();) use(hands.index(), hands.cards());
+/// Contiguous ranges keep the unindexing tables hot, so give each thread one range instead of interleaving.
+class CanonicalHands {
+public:
+    CanonicalHands(const Indexer& indexer, uint32_t round, hand_index_t begin, hand_index_t end)
+        : h(&indexer.h), round(round), idx(begin), end(end) {}
+
+    bool next() {
+        if (idx == end) return false;
+        hand_unindex(h, round, idx, hand.data());
+        cur = idx++;
+        return true;
+    }
+
+    hand_index_t index() const { return cur; }
+    const std::array<uint8_t, 7>& cards() const { return hand; }
+
+private:
+    const hand_indexer_t* h;
+    uint32_t round;
+    hand_index_t idx;
+    hand_index_t end;
+    hand_index_t cur = 0;
+    std::array<uint8_t, 7> hand{};
+};
+
+/// @brief Indexes every one card extension of a hand in a child indexer, eg the rivers of a turn.
+/// The child's rounds must be the hand's rounds, with one more card in the last one ({2, 4} -> {2, 5}).
+/// The earlier rounds are indexed once per hand and only the last round is redone per next card,
+/// through hand_index_next_round, instead of calling hand_index_last on every child.
+class NextCardIndexer {
+public:
+    explicit NextCardIndexer(const Indexer& child) : h(&child.h) {}
+
+    /// @param cards the hand, at least as many cards as the child's rounds minus one
+    /// @param children filled with the child index of each card not in the hand, in card order
+    /// @return number of children
+    size_t index_children(const uint8_t* cards, std::array<hand_index_t, 52>& children) const {
+        const uint32_t last_round = h->rounds - 1;
+
+        hand_indexer_state_t prefix;
+        hand_indexer_state_init(h, &prefix);
+
+        size_t pos = 0;
+        for (uint32_t r = 0; r < last_round; ++r) {
+            hand_index_next_round(h, cards + pos, &prefix);
+            pos += h->cards_per_round[r];
+        }
+
+        const size_t last_size = h->cards_per_round[last_round];
+        std::array<uint8_t, 7> last_cards;
+        uint64_t used = 0;
+        for (size_t i = 0; i < pos + last_size - 1; ++i) used |= uint64_t{1} << cards[i];
+        for (size_t i = 0; i + 1 < last_size; ++i) last_cards[i] = cards[pos + i];
+
+        size_t num_children = 0;
+        for (uint8_t c = 0; c < 52; ++c) {
+            if (used & (uint64_t{1} << c)) continue;
+            last_cards[last_size - 1] = c;
+            hand_indexer_state_t state = prefix;
+            children[num_children++] = hand_index_next_round(h, last_cards.data(), &state);
+        }
+        return num_children;
+    }
+
+private:
+    const hand_indexer_t* h;
+};
@@ -3,12 +3,20 @@
 #include <string>      
 #include <vector>       
 #include <utility>     
+#include <tuple>
 #include <fstream>     
 #include <filesystem>   
 #include <stdexcept>   
 #include <ios>  
 #include <type_traits>       
 #include <format>
+#include <span>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
 
 /// @brief Header used to store information for storing and retrieving matrices
 struct MatrixHeader{
@@ -37,6 +45,109 @@ struct MatrixHeader{
     }
 };
 
+/**
+ * Matrices are stored either in the raw format (a MatrixHeader followed by the row-major data) or, when the path
+ * ends in ".npy", as NumPy .npy files that np.load(path, mmap_mode='r') opens without copying.
+ * Writers pick the format from the path and every reader accepts both.
+ */
+
+inline bool is_npy_path(const std::string& path) {
+    return std::filesystem::path(path).extension() == ".npy";
+}
+
+/// @brief .npy dtype string of the header's element type, eg "<i4" or "|u1"
+inline std::string npy_descr(const MatrixHeader& header) {
+    char kind = header.is_float ? 'f' : (header.is_signed ? 'i' : 'u');
+    char order = header.bytes_per_elt == 1 ? '|' : '<';
+    return std::string{order, kind} + std::to_string(header.bytes_per_elt);
+}
+
+/// @brief Bytes that precede the data in a .npy (version 1.0) file. Padded to 64 bytes so the data stays aligned.
+inline std::string npy_preamble(const MatrixHeader& header) {
+    std::string dict = "{'descr': '" + npy_descr(header) + "', 'fortran_order': False, 'shape': (" +
+        std::to_string(header.num_rows) + ", " + std::to_string(header.num_cols) + "), }";
+
+    const size_t prefix = 10; // magic, version and header length
+    size_t total = prefix + dict.size() + 1;
+    total = (total + 63) / 64 * 64;
+    dict.append(total - prefix - dict.size() - 1, ' ');
+    dict.push_back('\n');
+
+    std::string preamble = "\x93NUMPY";
+    preamble.push_back(1);
+    preamble.push_back(0);
+    preamble.push_back(static_cast<char>(dict.size() & 0xff));
+    preamble.push_back(static_cast<char>(dict.size() >> 8));
+    return preamble + dict;
+}
+
+/// @brief Bytes that precede the data of a matrix written to path
+inline std::string matrix_preamble(const std::string& path, const MatrixHeader& header) {
+    if (is_npy_path(path)) return npy_preamble(header);
+    return std::string(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+/// @brief Parses the start of a matrix file, in either format.
+/// @param bytes the first size bytes of the file (4096 is always enough for our files)
+/// @return {header, offset of the data from the start of the file}
+/// @throws std::runtime_error on a truncated or unsupported header (big endian, fortran order, 3+ dims)
+inline std::pair<MatrixHeader, uint64_t> parse_matrix_preamble(const char* bytes, size_t size) {
+    const char magic[] = "\x93NUMPY";
+    const size_t magic_len = sizeof(magic) - 1;
+
+    if (size < magic_len || std::memcmp(bytes, magic, magic_len) != 0) {
+        if (size < sizeof(MatrixHeader)) throw std::runtime_error("missing header");
+        MatrixHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        return {header, sizeof(MatrixHeader)};
+    }
+
+    if (size < 10) throw std::runtime_error("truncated npy header");
+    const uint8_t major = static_cast<uint8_t>(bytes[6]);
+    const auto byte = [&](size_t i) { return static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])); };
+
+    uint64_t dict_start = major == 1 ? 10 : 12;
+    uint64_t dict_len = major == 1 ? (byte(8) | byte(9) << 8) : (byte(8) | byte(9) << 8 | byte(10) << 16 | byte(11) << 24);
+    if (dict_start + dict_len > size) throw std::runtime_error("truncated npy header");
+    std::string dict(bytes + dict_start, dict_len);
+
+    const auto value_after = [&](const std::string& key) {
+        size_t at = dict.find("'" + key + "':");
+        if (at == std::string::npos) throw std::runtime_error("npy header is missing " + key + ": " + dict);
+        at = dict.find_first_not_of(' ', at + key.size() + 3);
+        return at;
+    };
+
+    size_t descr_at = value_after("descr");
+    size_t descr_end = dict.find('\'', descr_at + 1);
+    std::string descr = dict.substr(descr_at + 1, descr_end - descr_at - 1);
+    if (descr.size() < 3 || descr[0] == '>' || std::string("fiu").find(descr[1]) == std::string::npos)
+        throw std::runtime_error("unsupported npy dtype: " + descr);
+
+    if (dict.compare(value_after("fortran_order"), 5, "False") != 0)
+        throw std::runtime_error("fortran ordered npy files are not supported");
+
+    size_t shape_at = value_after("shape");
+    std::string shape = dict.substr(shape_at + 1, dict.find(')', shape_at) - shape_at - 1);
+    std::vector<uint64_t> dims;
+    for (size_t at = 0; at < shape.size();) {
+        size_t end = std::min(shape.find(',', at), shape.size());
+        std::string dim = shape.substr(at, end - at);
+        if (dim.find_first_not_of(' ') != std::string::npos) dims.push_back(std::stoull(dim));
+        at = end + 1;
+    }
+    if (dims.empty() || dims.size() > 2) throw std::runtime_error("npy files must be 1 or 2 dimensional: " + dict);
+
+    MatrixHeader header{
+        .num_rows = dims[0],
+        .num_cols = dims.size() == 2 ? dims[1] : 1,
+        .bytes_per_elt = std::stoull(descr.substr(2)),
+        .is_signed = descr[1] != 'u',
+        .is_float = descr[1] == 'f'
+    };
+    return {header, dict_start + dict_len};
+}
+
 template <typename T>
 void header_type_check(MatrixHeader header){
 
@@ -69,22 +180,24 @@ void header_type_check(MatrixHeader header){
     }
 }
 
-template <typename T>
-std::pair<std::vector<T>, MatrixHeader> load_matrix_and_header(const std::string& result_path) {
+/// @tparam Alloc allocator of the returned vector, eg HugePageAllocator<T> for the solver tables
+template <typename T, typename Alloc = std::allocator<T>>
+std::pair<std::vector<T, Alloc>, MatrixHeader> load_matrix_and_header(const std::string& result_path) {
     //check against the header and throw an error if something goes wrong
     std::ifstream in(result_path, std::ios::binary);
     if (!in) throw std::runtime_error("cannot open " + result_path);
 
-    MatrixHeader header;
-    in.read(reinterpret_cast<char*>(&header), sizeof(header));
-    if (in.gcount() != static_cast<std::streamsize>(sizeof(header))) throw std::runtime_error("missing header");
+    char preamble[4096];
+    in.read(preamble, sizeof(preamble));
+    auto [header, data_offset] = parse_matrix_preamble(preamble, static_cast<size_t>(in.gcount()));
     header_type_check<T>(header);
+    in.clear();
 
     uint64_t expected_bytes = header.num_rows * header.num_cols * header.bytes_per_elt;
-    std::streampos here = in.tellg(); in.seekg(0, std::ios::end);
-    std::streampos end = in.tellg(); in.seekg(here);
+    in.seekg(0, std::ios::end);
+    std::streampos end = in.tellg(); in.seekg(static_cast<std::streamoff>(data_offset));
 
-    uint64_t file_bytes = static_cast<uint64_t>(end - here);
+    uint64_t file_bytes = static_cast<uint64_t>(end) - data_offset;
     if (file_bytes != expected_bytes){
         throw std::runtime_error("Header expected bytes=" +
         std::to_string(expected_bytes)+
@@ -93,7 +206,7 @@ std::pair<std::vector<T>, MatrixHeader> load_matrix_and_header(const std::string
         " do not match");
     }
 
-    std::vector<T> results(expected_bytes / sizeof(T));
+    std::vector<T, Alloc> results(expected_bytes / sizeof(T));
     in.read(reinterpret_cast<char*>(results.data()), static_cast<std::streamsize>(expected_bytes));
     
     uint64_t read_bytes = static_cast<uint64_t>(in.gcount());
@@ -108,8 +221,8 @@ std::pair<std::vector<T>, MatrixHeader> load_matrix_and_header(const std::string
     return {std::move(results), header};
 }
 
-template <typename T>
-inline void write_matrix_and_header(const std::string& write_path, MatrixHeader header, const std::vector<T>& results) {
+template <typename T, typename Alloc>
+inline void write_matrix_and_header(const std::string& write_path, MatrixHeader header, const std::vector<T, Alloc>& results) {
 
     //check against the header and throw an error if something goes wrong
     header_type_check<T>(header);
@@ -126,8 +239,140 @@ inline void write_matrix_and_header(const std::string& write_path, MatrixHeader
     std::ofstream out(write_path, std::ios::binary);
     if (!out) throw std::runtime_error("Can not open the path: " + write_path);
 
-    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    std::string preamble = matrix_preamble(write_path, header);
+    out.write(preamble.data(), static_cast<std::streamsize>(preamble.size()));
     out.write(reinterpret_cast<const char*>(results.data()),
               static_cast<std::streamsize>(results.size() * sizeof(T)));
     if (!out) throw std::runtime_error("Failed while writing to path: : " + write_path);
-}
\ No newline at end of file
+}
+
+/// @brief Read-only memory map of a matrix written by write_matrix_and_header (either format).
+/// Pages are only read in when they are touched and can be evicted again by the OS, so the matrix
+/// does not need to fit in RAM. Intended to be streamed front to back.
+template <typename T>
+class MappedMatrix {
+
+public:
+    explicit MappedMatrix(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+
+        base = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) throw std::runtime_error("mmap failed for " + path);
+        ::madvise(base, length, MADV_SEQUENTIAL);
+
+        try {
+            std::tie(header, data_offset) = parse_matrix_preamble(static_cast<const char*>(base), std::min<size_t>(length, 4096));
+            header_type_check<T>(header);
+            uint64_t expected_bytes = header.num_rows * header.num_cols * header.bytes_per_elt;
+            uint64_t file_bytes = length - data_offset;
+            if (file_bytes != expected_bytes){
+                throw std::runtime_error("Header expected bytes=" +
+                std::to_string(expected_bytes)+
+                " and recieved bytes="+
+                std::to_string(file_bytes) + 
+                " do not match");
+            }
+        }
+        catch (...) {
+            ::munmap(base, length);
+            throw;
+        }
+    }
+
+    ~MappedMatrix() { if (base != MAP_FAILED) ::munmap(base, length); }
+    MappedMatrix(const MappedMatrix&) = delete;
+    MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+    const MatrixHeader& get_header() const { return header; }
+
+    std::span<const T> data() const {
+        const T* first = reinterpret_cast<const T*>(static_cast<const char*>(base) + data_offset);
+        return {first, header.num_rows * header.num_cols};
+    }
+
+private:
+    void* base = MAP_FAILED;
+    size_t length = 0;
+    MatrixHeader header;
+    uint64_t data_offset = 0;
+};
+
+/// @brief Writes a matrix to disk a block of rows at a time, so it never has to be held in memory.
+/// The file layout matches write_matrix_and_header, so it is a .npy file iff the path ends in ".npy".
+template <typename T>
+class MatrixWriter {
+
+public:
+    MatrixWriter(const std::string& write_path, MatrixHeader header): path(write_path), header(header) {
+        header_type_check<T>(header);
+        out.open(path, std::ios::binary);
+        if (!out) throw std::runtime_error("Can not open the path: " + path);
+        std::string preamble = matrix_preamble(path, header);
+        out.write(preamble.data(), static_cast<std::streamsize>(preamble.size()));
+    }
+
+    void append(std::span<const T> elts) {
+        out.write(reinterpret_cast<const char*>(elts.data()), static_cast<std::streamsize>(elts.size() * sizeof(T)));
+        num_written += elts.size();
+    }
+
+    /// @throws std::runtime_error if the number of elements written does not match the header
+    void finish() {
+        uint64_t expected_num_elts = header.num_rows * header.num_cols;
+        if (expected_num_elts != num_written){
+            throw std::runtime_error("Expected num elts="+
+            std::to_string(expected_num_elts)+
+            " and recieved num elts="+
+            std::to_string(num_written)+
+            " do not match");
+        }
+        out.flush();
+        if (!out) throw std::runtime_error("Failed while writing to path: " + path);
+    }
+
+private:
+    std::string path;
+    MatrixHeader header;
+    std::ofstream out;
+    uint64_t num_written = 0;
+};
+
+/// @brief Rewrites a matrix file in the format given by out_path (see is_npy_path), streaming the data across.
+/// Mainly for turning existing raw artifacts into .npy files for the notebooks.
+inline void convert_matrix(const std::string& in_path, const std::string& out_path) {
+    std::ifstream in(in_path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open " + in_path);
+
+    char preamble[4096];
+    in.read(preamble, sizeof(preamble));
+    auto [header, data_offset] = parse_matrix_preamble(preamble, static_cast<size_t>(in.gcount()));
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(data_offset));
+
+    std::ofstream out(out_path, std::ios::binary);
+    if (!out) throw std::runtime_error("Can not open the path: " + out_path);
+    std::string out_preamble = matrix_preamble(out_path, header);
+    out.write(out_preamble.data(), static_cast<std::streamsize>(out_preamble.size()));
+
+    uint64_t remaining = header.num_rows * header.num_cols * header.bytes_per_elt;
+    std::vector<char> block(1 << 20);
+    while (remaining > 0) {
+        std::streamsize want = static_cast<std::streamsize>(std::min<uint64_t>(remaining, block.size()));
+        in.read(block.data(), want);
+        if (in.gcount() != want) throw std::runtime_error("matrix data is shorter than its header: " + in_path);
+        out.write(block.data(), want);
+        remaining -= static_cast<uint64_t>(want);
+    }
+
+    out.flush();
+    if (!out) throw std::runtime_error("Failed while writing to path: " + out_path);
+}
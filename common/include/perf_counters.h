@@ -0,0 +1,70 @@
+/**
+ * @file perf_counters.h
+ * @brief Optional hardware counter profiling of named regions, built on Linux perf_event_open.
+ * Only compiled in when PERF_COUNTERS is defined (make PERF=1). Otherwise the macros below expand to nothing.
+ *
+ * PERF_REGION("traverse"); counts cycles, instructions, LLC misses, dTLB misses and branch misses of the calling
+ * thread from that line to the end of the enclosing scope, and adds them to the thread's totals for that name.
+ * Every thread opens its own counter group the first time it enters a region.
+ * PERF_REPORT(std::cout); prints the totals per region, summed over the threads and then per thread.
+ * @warning The counters are per thread (no inherit), so a region covers only the threads that enter it. A region
+ * around a whole OpenMP loop, like the clustering stages in stage_graph.cpp, counts the calling thread alone and
+ * misses the rest of the team; report() labels regions entered by a single thread "(calling thread only)".
+ *
+ * @note Opening counters can fail (eg perf_event_paranoid, or a VM without a PMU). A warning is printed
+ * once and the missing counters read as zero, the program still runs.
+ */
+
+#pragma once
+
+#ifdef PERF_COUNTERS
+
+#ifndef __linux__
+#error "PERF_COUNTERS needs Linux perf_event_open"
+#endif
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+namespace perf{
+
+inline constexpr size_t num_events = 5;
+
+/// @brief cycles, instructions, LLC misses, dTLB misses, branch misses
+using EventCounts = std::array<uint64_t, num_events>;
+
+struct ThreadCounters;
+
+/// @brief Counts the calling thread's events from construction to destruction under name.
+class Region{
+
+public:
+    explicit Region(std::string_view name);
+    ~Region();
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+
+private:
+    ThreadCounters& counters;
+    std::string_view name;
+    EventCounts start;
+};
+
+/// @brief Prints the counts of every region, over all threads and then per thread.
+void report(std::ostream& out);
+
+}
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define PERF_REGION(name) perf::Region PERF_CONCAT(perf_region_, __LINE__)(name)
+#define PERF_REPORT(out) perf::report(out)
+
+#else
+
+#define PERF_REGION(name) do {} while (0)
+#define PERF_REPORT(out) do {} while (0)
+
+#endif
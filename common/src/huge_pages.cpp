@@ -0,0 +1,214 @@
+#include "huge_pages.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace huge_pages{
+
+namespace {
+
+    constexpr size_t two_mb = size_t{1} << 21;
+    constexpr size_t one_gb = size_t{1} << 30;
+    constexpr size_t small_limit = two_mb; // below this operator new is used
+
+    const std::array<std::string, 4> mode_names = {"off", "thp", "2mb", "1gb"};
+
+    enum class Backing{ small_pages, thp, hugetlb_2mb, hugetlb_1gb };
+
+    struct Mapping{
+        size_t length;
+        Backing backing;
+    };
+
+    std::atomic<Mode> current_mode{Mode::off};
+    std::mutex mappings_mutex;
+    std::map<uintptr_t, Mapping> mappings; // by start address, so deallocate knows the mapped length
+
+    size_t round_up(size_t n, size_t to){ return (n + to - 1) / to * to; }
+
+    void warn_once(bool& warned, const std::string& msg){
+        if (warned) return;
+        warned = true;
+        std::cerr << "huge pages: " << msg << '\n';
+    }
+
+    /// @brief length bytes of anonymous memory starting on an align boundary, nullptr on failure
+    void* map_aligned(size_t length, size_t align){
+        void* raw = ::mmap(nullptr, length + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return nullptr;
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = round_up(start, align);
+        if (aligned > start) ::munmap(raw, aligned - start);
+        size_t tail = start + length + align - (aligned + length);
+        if (tail > 0) ::munmap(reinterpret_cast<void*>(aligned + length), tail);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+#ifdef MAP_HUGETLB
+    void* map_hugetlb(size_t length, int page_shift){
+        void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT), -1, 0);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+#endif
+
+    void* record(void* p, size_t length, Backing backing){
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        mappings[reinterpret_cast<uintptr_t>(p)] = {length, backing};
+        return p;
+    }
+
+    std::string format_bytes(double bytes){
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        if (bytes >= double(one_gb)) out << bytes / double(one_gb) << " GB";
+        else out << bytes / double(1 << 20) << " MB";
+        return out.str();
+    }
+
+    std::string format_page(size_t kb){
+        if (kb >= (size_t{1} << 20)) return std::to_string(kb >> 20) + " GB";
+        if (kb >= 1024) return std::to_string(kb >> 10) + " MB";
+        return std::to_string(kb) + " KB";
+    }
+
+    /// @brief What /proc/self/smaps reports for the mapping containing an address, in kB, all 0 if not found
+    struct SmapsPages{
+        size_t kernel_page_kb = 0;
+        size_t huge_kb = 0; // AnonHugePages, the transparent huge pages of the mapping
+        size_t rss_kb = 0;
+    };
+
+    SmapsPages smaps_pages(uintptr_t addr){
+        std::ifstream in("/proc/self/smaps");
+        bool inside = false;
+        SmapsPages pages;
+        for (std::string line; std::getline(in, line);){
+            size_t dash = line.find('-');
+            size_t space = line.find(' ');
+            bool is_range = dash != std::string::npos && space != std::string::npos && dash < space
+                && line.find(':') > space;
+            if (is_range){
+                if (inside) break;
+                uintptr_t lo = std::stoull(line.substr(0, dash), nullptr, 16);
+                uintptr_t hi = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+                inside = lo <= addr && addr < hi;
+                continue;
+            }
+            if (!inside) continue;
+            if (line.starts_with("Rss:")) pages.rss_kb = std::stoull(line.substr(4));
+            else if (line.starts_with("AnonHugePages:")) pages.huge_kb = std::stoull(line.substr(14));
+            else if (line.starts_with("KernelPageSize:")) pages.kernel_page_kb = std::stoull(line.substr(15));
+        }
+        return pages;
+    }
+}
+
+Mode parse_mode(const std::string& name){
+    for (size_t i = 0; i < mode_names.size(); ++i)
+        if (mode_names[i] == name) return static_cast<Mode>(i);
+    throw std::runtime_error("unknown huge_pages mode \"" + name + "\", expected off, thp, 2mb or 1gb");
+}
+
+std::string to_string(Mode mode){ return mode_names[static_cast<size_t>(mode)]; }
+
+void set_mode(Mode mode){ current_mode = mode; }
+Mode get_mode(){ return current_mode; }
+
+void* allocate(size_t bytes){
+    if (bytes < small_limit) return ::operator new(bytes);
+    Mode mode = current_mode;
+
+#ifdef MAP_HUGETLB
+    if (mode == Mode::hugetlb_1gb){
+        size_t length = round_up(bytes, one_gb);
+        if (void* p = map_hugetlb(length, 30)) return record(p, length, Backing::hugetlb_1gb);
+        static bool warned = false;
+        warn_once(warned, "no free 1 GB pages, trying 2 MB pages");
+    }
+    if (mode == Mode::hugetlb_1gb || mode == Mode::hugetlb_2mb){
+        size_t length = round_up(bytes, two_mb);
+        if (void* p = map_hugetlb(length, 21)) return record(p, length, Backing::hugetlb_2mb);
+        static bool warned = false;
+        warn_once(warned, "no free 2 MB pages (see /proc/sys/vm/nr_hugepages), using transparent huge pages");
+    }
+#else
+    if (mode == Mode::hugetlb_1gb || mode == Mode::hugetlb_2mb){
+        static bool warned = false;
+        warn_once(warned, "hugetlb pages need Linux, using transparent huge pages");
+    }
+#endif
+
+    if (mode == Mode::off){
+        // opted out explicitly, as a transparent_hugepage=always kernel would otherwise back it with huge pages anyway
+        size_t length = round_up(bytes, static_cast<size_t>(::sysconf(_SC_PAGESIZE)));
+        void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_NOHUGEPAGE
+        ::madvise(p, length, MADV_NOHUGEPAGE);
+#endif
+        return record(p, length, Backing::small_pages);
+    }
+
+    size_t length = round_up(bytes, two_mb);
+    void* p = map_aligned(length, two_mb);
+    if (!p) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+    if (::madvise(p, length, MADV_HUGEPAGE) == 0) return record(p, length, Backing::thp);
+#endif
+    static bool warned = false;
+    warn_once(warned, "transparent huge pages are not available, using 4 KB pages");
+    return record(p, length, Backing::small_pages);
+}
+
+void deallocate(void* p, size_t bytes) noexcept {
+    if (bytes < small_limit) { ::operator delete(p); return; }
+
+    std::lock_guard<std::mutex> lock(mappings_mutex);
+    auto it = mappings.find(reinterpret_cast<uintptr_t>(p));
+    if (it == mappings.end()) return;
+    ::munmap(p, it->second.length);
+    mappings.erase(it);
+}
+
+std::string describe(const void* p){
+    Mapping mapping;
+    {
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        auto it = mappings.find(reinterpret_cast<uintptr_t>(p));
+        if (it == mappings.end()) return "4 KB pages";
+        mapping = it->second;
+    }
+
+    // smaps reports the whole vma, which the kernel may have merged with neighbouring mappings
+    SmapsPages pages = smaps_pages(reinterpret_cast<uintptr_t>(p));
+    bool hugetlb = mapping.backing == Backing::hugetlb_1gb || mapping.backing == Backing::hugetlb_2mb;
+    if (hugetlb){
+        if (pages.kernel_page_kb == 0) return mapping.backing == Backing::hugetlb_1gb ? "1 GB hugetlb pages" : "2 MB hugetlb pages";
+        return format_page(pages.kernel_page_kb) + " hugetlb pages";
+    }
+
+    std::string advice = mapping.backing == Backing::thp ? "transparent huge pages advised" : "transparent huge pages disabled";
+    if (pages.rss_kb == 0) return advice + ", nothing resident yet";
+    std::ostringstream out;
+    if (pages.huge_kb == 0) out << format_page(pages.kernel_page_kb == 0 ? 4 : pages.kernel_page_kb) << " pages";
+    else out << "transparent huge pages for " << (100 * pages.huge_kb / pages.rss_kb) << "%";
+    out << " of " << format_bytes(double(pages.rss_kb) * 1024.0) << " (" << advice << ")";
+    return out.str();
+}
+
+}
@@ -0,0 +1,181 @@
+#include "perf_counters.h"
+
+#ifdef PERF_COUNTERS
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace perf{
+
+namespace {
+
+    constexpr uint64_t cache_event(uint64_t cache, uint64_t op, uint64_t result){
+        return cache | (op << 8) | (result << 16);
+    }
+
+    struct EventSpec{
+        const char* name;
+        uint32_t type;
+        uint64_t config;
+    };
+
+    constexpr std::array<EventSpec, num_events> events = {{
+        {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {"llc_misses", PERF_TYPE_HW_CACHE,
+            cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {"dtlb_misses", PERF_TYPE_HW_CACHE,
+            cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+
+    int open_event(const EventSpec& spec, int group_fd){
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = group_fd == -1 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        // pid 0, cpu -1: the calling thread on any cpu
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+}
+
+struct RegionTotals{
+    std::string name;
+    uint64_t calls = 0;
+    EventCounts counts{};
+};
+
+/// @brief One thread's counter group and per region totals. Only its own thread writes it.
+struct ThreadCounters{
+    size_t thread_idx;
+    int leader = -1;
+    std::vector<size_t> opened; // events in the group, in group read order
+    std::vector<RegionTotals> regions;
+
+    explicit ThreadCounters(size_t thread_idx): thread_idx(thread_idx){
+        for (size_t e = 0; e < num_events; ++e){
+            int fd = open_event(events[e], leader);
+            if (fd < 0) continue;
+            if (leader == -1) leader = fd;
+            opened.push_back(e);
+        }
+
+        if (leader != -1){
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    EventCounts read_counts() const {
+        EventCounts counts{};
+        if (leader == -1) return counts;
+
+        std::array<uint64_t, num_events + 1> buf{}; // nr, then one value per event
+        if (::read(leader, buf.data(), sizeof(buf)) <= 0) return counts;
+        for (size_t i = 0; i < opened.size() && i < buf[0]; ++i) counts[opened[i]] = buf[i + 1];
+        return counts;
+    }
+
+    RegionTotals& totals(std::string_view name){
+        auto it = std::ranges::find(regions, name, &RegionTotals::name);
+        if (it != regions.end()) return *it;
+        regions.push_back({std::string(name)});
+        return regions.back();
+    }
+};
+
+namespace {
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadCounters>> registry; // never shrinks, so the thread_local pointers stay valid
+    thread_local ThreadCounters* this_thread = nullptr;
+
+    ThreadCounters& thread_counters(){
+        if (this_thread) return *this_thread;
+
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        registry.push_back(std::make_unique<ThreadCounters>(registry.size()));
+        this_thread = registry.back().get();
+
+        static bool warned = false;
+        if (this_thread->opened.size() != num_events && !warned){
+            warned = true;
+            std::cerr << "perf: only " << this_thread->opened.size() << " of " << num_events
+                << " counters could be opened, the rest read as 0 (check /proc/sys/kernel/perf_event_paranoid)\n";
+        }
+        return *this_thread;
+    }
+
+    void print_row(std::ostream& out, const std::string& label, uint64_t calls, const EventCounts& c){
+        double kinstr = std::max(1.0, static_cast<double>(c[1]) / 1000.0);
+        out << std::left << std::setw(36) << label << std::right << std::setw(12) << calls
+            << std::setw(18) << c[0] << std::setw(18) << c[1]
+            << std::fixed << std::setprecision(2) << std::setw(8) << (c[0] ? static_cast<double>(c[1]) / static_cast<double>(c[0]) : 0.0)
+            << std::setprecision(3) << std::setw(12) << static_cast<double>(c[2]) / kinstr
+            << std::setw(12) << static_cast<double>(c[3]) / kinstr
+            << std::setw(12) << static_cast<double>(c[4]) / kinstr << '\n';
+    }
+}
+
+Region::Region(std::string_view name): counters(thread_counters()), name(name), start(counters.read_counts()){}
+
+Region::~Region(){
+    EventCounts end = counters.read_counts();
+    RegionTotals& totals = counters.totals(name);
+    ++totals.calls;
+    for (size_t e = 0; e < num_events; ++e) totals.counts[e] += end[e] - start[e];
+}
+
+void report(std::ostream& out){
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    std::vector<RegionTotals> summed;
+    std::vector<size_t> threads_in; // per summed region, the threads that entered it
+    for (const auto& thread : registry){
+        for (const RegionTotals& r : thread->regions){
+            auto it = std::ranges::find(summed, r.name, &RegionTotals::name);
+            if (it == summed.end()){
+                it = summed.insert(summed.end(), {r.name});
+                threads_in.push_back(0);
+            }
+            ++threads_in[static_cast<size_t>(it - summed.begin())];
+            it->calls += r.calls;
+            for (size_t e = 0; e < num_events; ++e) it->counts[e] += r.counts[e];
+        }
+    }
+
+    out << "\nhardware counters (misses are per 1000 instructions). A region counts only the threads that entered it,\n"
+        << "so one entered by a single thread leaves out the work of any threads it started (eg OpenMP loops inside)\n";
+    out << std::left << std::setw(36) << "region" << std::right << std::setw(12) << "calls" << std::setw(18) << "cycles"
+        << std::setw(18) << "instructions" << std::setw(8) << "IPC" << std::setw(12) << "llc" << std::setw(12) << "dtlb"
+        << std::setw(12) << "branch" << '\n';
+
+    for (size_t i = 0; i < summed.size(); ++i){
+        const RegionTotals& r = summed[i];
+        print_row(out, threads_in[i] == 1 ? r.name + " (calling thread only)" : r.name, r.calls, r.counts);
+        for (const auto& thread : registry){
+            auto it = std::ranges::find(thread->regions, r.name, &RegionTotals::name);
+            if (it != thread->regions.end())
+                print_row(out, "  thread " + std::to_string(thread->thread_idx), it->calls, it->counts);
+        }
+    }
+}
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include "indices.h"
 #include "poker_state.h"
 #include <random>
 #include <vector>
@@ -11,12 +12,13 @@ struct PublicState{
     std::array<double,2> payoffs;
     bool folded;
     std::vector<Action> edge_labels;
+    std::vector<int> edge_bet_idxs; // for raises, the index into bet_sizes[street_idx] that produced it, else -1
 };
 
 struct TreeNode{
-    size_t node_idx;
-    size_t parent_idx;
-    std::vector<size_t> child_idxs;
+    NodeIdx node_idx;
+    NodeIdx parent_idx;
+    std::vector<NodeIdx> child_idxs;
 };
 
 class ActionTree{
@@ -24,6 +26,7 @@ class ActionTree{
 private:
 
     int raise_to_x_pot(double x, const PokerState& state) const;
+    int bet_size_idx(const Action& action, const PokerState& state) const;
     std::vector<Action> get_actions(const PokerState& state);
     std::vector<Action> get_legal_actions(const PokerState& state);
 
@@ -31,13 +34,14 @@ private:
     
 public:
 
-    size_t root_idx;
+    NodeIdx root_idx;
     std::vector<TreeNode> nodes; 
     std::vector<PublicState> pub_states;
 
     //array of bet sizes per street with bet sizes encoded as floats where (0.333 = 1/3 pot bet)
     std::vector<std::vector<float>> bet_sizes; 
 
+    /// @throws std::runtime_error if the tree has more nodes than NodeIdx holds
     ActionTree(const PokerState& root_state, const std::vector<std::vector<float>>& bet_szs);
 
     size_t apply_action(size_t node_idx, size_t action_idx) const{
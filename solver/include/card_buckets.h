@@ -1,13 +1,14 @@
 #pragma once
 #include "matrix_loader.h"
+#include "huge_pages.h"
 #include <cstdint>
 #include <stdexcept>
 #include <vector>
 #include <string>
 #include <algorithm>
 
-template <class T>
-static size_t count_clusters(const std::vector<T>& assign) {
+template <class Vec>
+static size_t count_clusters(const Vec& assign) {
     if (assign.size() == 0) throw std::runtime_error("The assignment is empty. Cannot get max");
     return std::ranges::max(assign) + size_t{1};
 }
@@ -20,9 +21,9 @@ struct BucketPaths{
 
 struct CardBuckets {
     std::vector<int> preflop_clusters;
-    std::vector<int> flop_clusters;
-    std::vector<int> turn_clusters;
-    std::vector<int> river_clusters;
+    HugeVector<int> flop_clusters; // indexed by hand, so randomly accessed and up to ~500MB (river)
+    HugeVector<int> turn_clusters;
+    HugeVector<int> river_clusters;
     std::vector<size_t> cluster_counts;
 
     CardBuckets() = default; 
@@ -40,13 +41,13 @@ struct CardBuckets {
             preflop_clusters[i] = static_cast<int>(i);
         }
 
-        auto [fc, flop_header] = load_matrix_and_header<int>(bp.flop_path.string());
+        auto [fc, flop_header] = load_matrix_and_header<int, HugePageAllocator<int>>(bp.flop_path.string());
         flop_clusters = std::move(fc);
 
-        auto[tc, turn_header] = load_matrix_and_header<int>(bp.turn_path.string());
+        auto[tc, turn_header] = load_matrix_and_header<int, HugePageAllocator<int>>(bp.turn_path.string());
         turn_clusters = std::move(tc);
 
-        auto [rc, river_header] = load_matrix_and_header<int>(bp.river_path.string());
+        auto [rc, river_header] = load_matrix_and_header<int, HugePageAllocator<int>>(bp.river_path.string());
         river_clusters = std::move(rc);
 
         cluster_counts.clear();
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <random>
 #include <vector>
 #include <array>
@@ -13,22 +14,56 @@
 #include "info_sets.h"
 #include "action_tree.h"
 #include "dealer.h"
+#include "telemetry.h"
+#include "numa_placement.h"
 
 struct ThreadBuff{
     std::mt19937 rng;
     std::vector<std::vector<double>> probs_scratch;
     std::vector<std::vector<double>> deltas_scratch;
     Dealer dealer;
+    ThreadStats stats; // counters for the current batch, see telemetry.h
+    bool count_visits = false; // whether the current iteration is sampled for the infoset visit counts
+    bool traversing = false; // inside its own iteration, so stolen subtree time is already in stats.traverse_seconds
+    double weight = 1.0; // regret and strategy update weight of the current iteration's epoch, 1 unless scheduler = epochs
 };
 
+/// @brief How CFR::train spreads the iterations over the threads.
+/// omp_for: an omp for over whole iterations in omp_chunk_sz chunks, with a barrier at the end of every batch.
+/// tasks: the chunks are tasks, and traverser nodes shallower than task_depth run each action's subtree as a
+/// task. Threads that run out of iterations steal subtrees of the ones still running instead of idling at the
+/// batch end (which is when the batch's tasks are all done), and they split the discount too.
+/// epochs: one parallel region for the whole call, with threads claiming omp_chunk_sz iterations at a time from an
+/// atomic counter and no batch boundaries at all. Every iters_per_discount iterations start a new epoch, and
+/// instead of scaling the tables each epoch's updates are weighted up by 1 / (the discount so far), which is
+/// published per epoch. The tables are scaled once at the end of the call, which leaves them as the batch by batch
+/// discount would (up to the usual hogwild staleness around epoch changes).
+enum class Scheduler{ omp_for, tasks, epochs };
+
+struct SchedulerParams{
+    Scheduler scheduler = Scheduler::omp_for;
+    size_t task_depth = 2;
+};
+
+/// @brief "for", "tasks" or "epochs"
+/// @throws std::runtime_error on anything else
+Scheduler parse_scheduler(const std::string& name);
+std::string to_string(Scheduler scheduler);
+
 class CFR {
 
     private:
         CardBuckets card_buckets;
         ActionTree action_tree;
         InfoSets infosets;
+        ThreadStats totals; // every thread's stats summed over all train calls so far
+        numa::NumaParams numa_params;
+        numa::Topology topology;
+        SchedulerParams scheduler_params;
+        std::vector<ThreadBuff>* task_buffs = nullptr; // every thread's buffer while a tasks scheduler train runs
 
-        double traverse(int player, size_t node_idx, size_t depth, ThreadBuff& buff);
+        void run_iteration(size_t iter, size_t visit_sample_every, ThreadBuff& buff);
+        double traverse(int player, size_t node_idx, size_t depth, const Dealer& dealer, ThreadBuff& buff);
         std::vector<ThreadBuff> make_thread_buffs(size_t num_threads, uint32_t base_seed);
 
     public:
@@ -37,10 +72,23 @@ class CFR {
         InfoKey get_InfoKey(size_t node_idx, const ActionTree& at, const Dealer& d) const;
         
         void train(size_t iters, size_t iters_per_discount, 
-            size_t num_threads, size_t omp_chunk_sz, uint32_t base_seed);
+            size_t num_threads, size_t omp_chunk_sz, uint32_t base_seed,
+            size_t visit_sample_every = 0, const TelemetryParams& telemetry = {});
+
+        /// @brief Places the regret and strategy pages now per params.placement, and pins the threads of later
+        /// train calls per params.affinity. See numa_placement.h.
+        void set_numa(const numa::NumaParams& params);
+
+        void set_scheduler(const SchedulerParams& params){ scheduler_params = params; }
+
+        /// @brief Zeroes the regrets, strategy sums, visit counts and train stats, back to iteration 0.
+        void reset();
 
         const ActionTree& get_action_tree()const {return action_tree;}
         const InfoSets& get_infosets()const {return infosets;}
+        const CardBuckets& get_card_buckets()const {return card_buckets;}
+        uint64_t get_nodes_visited() const {return totals.total_nodes();} // nodes traversed by all train calls so far
+        const ThreadStats& get_train_stats() const {return totals;}
         double get_reward(const Dealer& dealer, size_t node_idx, int player);
 
 
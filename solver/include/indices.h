@@ -0,0 +1,69 @@
+/**
+ * @file indices.h
+ * @brief Compact index types for the structures the traversal walks: 32 bit node and child indices in ActionTree
+ * and InfoKey, and 40 bit offsets in InfoSets. Sizes are checked when the tree and the infosets are built,
+ * so an abstraction too big for them fails up front instead of wrapping around.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using NodeIdx = uint32_t;    // index into ActionTree::nodes
+using ClusterIdx = uint32_t; // bucket of a hand on a street
+using ActionCount = uint32_t;
+
+/// @brief value as a To
+/// @throws std::runtime_error if it does not fit, naming what
+template <class To>
+To checked_index(size_t value, const char* what){
+    if (value > std::numeric_limits<To>::max())
+        throw std::runtime_error(std::string(what) + " " + std::to_string(value) + " does not fit in "
+            + std::to_string(8 * sizeof(To)) + " bits");
+    return static_cast<To>(value);
+}
+
+/// @brief Per node offsets into the infoset tables (regret/strategy entries, visit rows), 40 bits each: the low 32
+/// in one array and the high 8 in another, 5 bytes a node instead of 8. 2^40 entries is 8 TB of doubles per table.
+class PackedOffsets{
+
+    std::vector<uint32_t> lo;
+    std::vector<uint8_t> hi;
+
+public:
+
+    static constexpr size_t bits = 40;
+    static constexpr size_t max_offset = (size_t{1} << bits) - 1;
+    static constexpr size_t bytes_per_offset = sizeof(uint32_t) + sizeof(uint8_t);
+
+    PackedOffsets() = default;
+    /// @throws std::runtime_error if an offset needs more than 40 bits
+    explicit PackedOffsets(const std::vector<size_t>& offsets){
+        reserve(offsets.size());
+        for (size_t offset : offsets) push_back(offset);
+    }
+
+    size_t operator[](size_t node_idx) const { return (size_t{hi[node_idx]} << 32) | lo[node_idx]; }
+    size_t size() const { return lo.size(); }
+    bool empty() const { return lo.empty(); }
+
+    void reserve(size_t n){ lo.reserve(n); hi.reserve(n); }
+
+    /// @throws std::runtime_error if offset needs more than 40 bits
+    void push_back(size_t offset){
+        if (offset > max_offset) throw std::runtime_error("infoset offset " + std::to_string(offset) + " does not fit in 40 bits");
+        lo.push_back(static_cast<uint32_t>(offset));
+        hi.push_back(static_cast<uint8_t>(offset >> 32));
+    }
+
+    /// @brief the full width offsets, the layout of the checkpoint file
+    std::vector<size_t> unpack() const {
+        std::vector<size_t> out(size());
+        for (size_t i = 0; i < out.size(); ++i) out[i] = (*this)[i];
+        return out;
+    }
+};
@@ -2,31 +2,36 @@
 #include "card_buckets.h"
 #include "action.h"
 #include "action_tree.h"
+#include "huge_pages.h"
+#include "indices.h"
 
 #include <filesystem>
 #include <vector>
 #include <string>
 #include <utility>
 #include <random>
+#include <cstdint>
 
 struct ISetsPaths{
     std::string regret_path;
     std::string strategy_path;
     std::string offset_path;
     std::string iters_path;
+    std::string visits_path = ""; // optional, empty if the visit counts are not saved/loaded
 
     void remove() const{
         std::filesystem::remove(regret_path);
         std::filesystem::remove(strategy_path);
         std::filesystem::remove(offset_path);
         std::filesystem::remove(iters_path);
+        if (!visits_path.empty()) std::filesystem::remove(visits_path);
     };
 };
 
 struct InfoKey {
-    size_t node_idx;
-    size_t cluster_idx;
-    size_t num_actions;
+    NodeIdx node_idx;
+    ClusterIdx cluster_idx;
+    ActionCount num_actions;
 };
 
 class InfoSets {
@@ -34,24 +39,31 @@ class InfoSets {
 public:
 
     inline size_t get_offset(const InfoKey& ikey)  const{
-        return offsets[ikey.node_idx] + ikey.cluster_idx*ikey.num_actions;
+        return offsets[ikey.node_idx] + size_t{ikey.cluster_idx}*ikey.num_actions;
     }
 
-    std::vector<size_t> offsets;  
-    std::vector<double> regret_sum; 
-    std::vector<double> strategy_sum; 
+    PackedOffsets offsets;
+    HugeVector<double> regret_sum; // huge page backed per [memory] huge_pages in train.toml, see huge_pages.h
+    HugeVector<double> strategy_sum; 
     int last_discount_iter = 0;
     int cur_iter = 0;
 
+    // optional sampled visit counts, one per (node, cluster) row: visits[row_offsets[node_idx] + cluster_idx].
+    // Empty unless init_visits was called. Saturates instead of wrapping.
+    std::vector<uint32_t> visits;
+    PackedOffsets row_offsets;
+
+    /// @throws std::runtime_error if an offset needs more than 40 bits or a cluster count more than 32
     explicit InfoSets(const ActionTree& action_tree, const std::vector<size_t>& cluster_counts);
 
     explicit InfoSets(const ISetsPaths& paths);
 
     void write_ckpt(const ISetsPaths& paths) const;
 
-    void update_regret(const InfoKey& ikey, const std::vector<double>& action_deltas);
+    /// @param weight scales the deltas, see the epochs scheduler in cfr.h
+    void update_regret(const InfoKey& ikey, const std::vector<double>& action_deltas, double weight = 1.0);
 
-    void update_strategy(const InfoKey& ikey, std::vector<double>& cur_strat);
+    void update_strategy(const InfoKey& ikey, std::vector<double>& cur_strat, double weight = 1.0);
 
     void get_regret_strategy(const InfoKey& ikey, std::vector<double>& output) const;
 
@@ -61,4 +73,15 @@ public:
 
     void discount(int t);
 
+    /// @brief Sets up row_offsets for the tree and zeroed visit counts, unless counts were loaded from a checkpoint
+    /// @throws std::runtime_error if loaded counts do not match the tree
+    void init_visits(const ActionTree& action_tree, const std::vector<size_t>& cluster_counts);
+
+    /// @brief Counts a visit to the row of ikey. Like the regret updates this is not atomic,
+    /// so concurrent visits to the same row can be lost, which is fine for sampled counts.
+    inline void count_visit(const InfoKey& ikey){
+        uint32_t& v = visits[row_offsets[ikey.node_idx] + ikey.cluster_idx];
+        if (v != UINT32_MAX) ++v;
+    }
+
 };
\ No newline at end of file
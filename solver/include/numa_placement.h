@@ -0,0 +1,70 @@
+/**
+ * @file numa_placement.h
+ * @brief Training thread pinning and NUMA placement of the infoset arrays, set in the [numa] section of
+ * configs/train.toml. Linux only, through sched_setaffinity and mbind, so no libnuma is needed.
+ * On other platforms, or a single node machine, placement does nothing and pinning is skipped.
+ *
+ * External sampling walks every street of the tree on every iteration, so no thread owns a street or subtree.
+ * Placement therefore spreads the regret_sum/strategy_sum pages over the nodes, instead of leaving them all on
+ * the node of the thread that zeroed them, and pinning keeps each thread on one node.
+ */
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace numa{
+
+/// @brief none leaves the threads to the OS. compact fills the cpus of node 0 first, then node 1 and so on.
+/// spread deals the threads round robin over the nodes.
+enum class Affinity{ none, compact, spread };
+
+/// @brief first_touch keeps the pages where they were zeroed (node of the constructing thread).
+/// interleave spreads them page by page over the nodes. partition gives each node one contiguous range of
+/// equal size, which follows the layout of the rows (node order, so roughly by street).
+enum class Placement{ first_touch, interleave, partition };
+
+struct NumaParams{
+    Affinity affinity = Affinity::none;
+    Placement placement = Placement::first_touch;
+};
+
+/// @throws std::runtime_error on an unknown name
+Affinity parse_affinity(const std::string& name);
+Placement parse_placement(const std::string& name);
+std::string to_string(Affinity affinity);
+std::string to_string(Placement placement);
+
+/// @brief The cpus this process may run on, per NUMA node. A single node if the topology is not available.
+/// The process's cpus are read once, so a thread pinned by train does not narrow later topologies.
+struct Topology{
+    std::vector<int> node_ids;
+    std::vector<std::vector<int>> node_cpus;
+
+    size_t num_nodes() const { return node_ids.size(); }
+};
+
+Topology read_topology();
+
+/// @brief The cpu training thread i is pinned to, for each of num_threads threads. Empty for Affinity::none.
+std::vector<int> thread_cpus(const Topology& topology, Affinity affinity, size_t num_threads);
+
+/// @brief Pins the calling thread to cpu. Warns once and carries on if it fails.
+void pin_this_thread(int cpu);
+
+/// @brief Restores the calling thread's cpus on destruction. train pins the thread that calls it (OpenMP thread 0),
+/// which would otherwise stay on one cpu after it returns.
+class ScopedAffinity{
+    std::vector<int> saved;
+public:
+    ScopedAffinity();
+    ~ScopedAffinity();
+    ScopedAffinity(const ScopedAffinity&) = delete;
+    ScopedAffinity& operator=(const ScopedAffinity&) = delete;
+};
+
+/// @brief Moves the whole pages of [data, data + bytes) per placement. Warns once and carries on if it fails.
+void place(void* data, size_t bytes, const Topology& topology, Placement placement);
+
+}
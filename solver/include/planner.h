@@ -0,0 +1,10 @@
+#pragma once
+#include "training.h"
+
+/// @brief Capacity planning for an abstraction, run by `train plan`. Prints the tree shape and the exact
+/// regret/strategy sizes per street, computed from the tree and the bucket tables (loaded, as the cluster counts
+/// come from them) before the infosets are allocated.
+/// If the projected memory fits in physical memory, it then trains for about calibration_seconds with the
+/// configured threads and projects iterations per second and the time to train.train_iters.
+/// @throws std::runtime_error if train.train_iters or train.iters_per_discount is 0
+void run_planner(const CFRSpec& spec, const TrainParams& train, double calibration_seconds);
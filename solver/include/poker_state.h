@@ -4,31 +4,41 @@
 #include "dealer.h"
 
 #include <array>
+#include <cstdint>
 #include <random>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
+/// @brief The stakes and the current deal of a table. Every PokerState of a hand points at one, so stepping a
+/// state copies the betting only. Owned by the caller and must outlive its states.
+struct Table {
+    int starting_stack;
+    int big_blind;
+    int small_blind;
+    Dealer dealer; // dealt by the preflop apply_chance, so one hand at a time per Table
+
+    Table(int stack, int bb, int sb) : starting_stack(stack), big_blind(bb), small_blind(sb) {}
+};
+
+/// @brief The betting state of a hand, 32 bytes. Stakes and cards live in the Table.
 class PokerState {
 
 public:
 
-    int starting_stack;
-    int big_blind;
-    int small_blind;
+    Table* table;
     std::array<int, 2> stacks;
     std::array<int, 2> pips;
-    Dealer dealer;
-
     int pot;
-    int stage;
-    int active_player;
-    Action last_action;
+    int8_t stage;
+    int8_t active_player;
+    int8_t last_action_type; // Action::type of the previous action on this street, -1 at its start
 
-    PokerState(int stack, int bb, int sb);
+    explicit PokerState(Table& table);
 
-    PokerState apply_action(const Action& action);
-    PokerState apply_chance(std::mt19937 rng);
+    PokerState apply_action(const Action& action) const;
+    /// @brief the preflop chance node deals the table's dealer with rng
+    PokerState apply_chance(std::mt19937& rng) const;
 
     bool is_legal_action(const Action& action) const;
 
@@ -38,12 +48,10 @@ public:
 
     inline bool is_chance() const { return (stage%2 == 0) && stage != 8; }
 
-    inline bool player_folded() const {
-        Action fold_action = {0,0};
-        return (last_action == fold_action);
-    }
+    inline bool player_folded() const { return last_action_type == 0; }
 
-    inline const Dealer& get_dealer() const {return dealer;}
+    inline const Dealer& get_dealer() const {return table->dealer;}
+    inline int big_blind() const { return table->big_blind; }
 
     std::vector<uint8_t> get_cards(int player) const;
     double get_reward(int player) const;
@@ -53,7 +61,7 @@ public:
 
     //payoff for the player if the game ended right now
     inline double get_payoff(int player) const {
-        double output = (stacks[player] - starting_stack) + static_cast<double>(pot);
+        double output = (stacks[player] - table->starting_stack) + static_cast<double>(pot);
         return output;
     };
 
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+/// @brief Counters one training thread keeps for itself, so counting needs no atomics.
+/// Aligned to a cache line so that neighbouring threads' counters do not false share.
+struct alignas(64) ThreadStats{
+    uint64_t iters = 0;
+    std::array<uint64_t, 4> nodes{}; // nodes visited per street, terminal nodes included
+    uint64_t terminal_evals = 0;
+    double deal_seconds = 0.0;
+    double traverse_seconds = 0.0;
+    double wait_seconds = 0.0; // time spent idle at the end of batch barrier, filled in by Telemetry
+
+    uint64_t total_nodes() const { return std::accumulate(nodes.begin(), nodes.end(), uint64_t{0}); }
+    ThreadStats& operator+=(const ThreadStats& other);
+};
+
+struct TelemetryParams{
+    double interval_seconds = 0.0; // 0 disables telemetry
+    std::filesystem::path path; // JSON lines are appended here. If empty a status line is printed to stdout instead
+};
+
+/// @brief Periodic training telemetry. CFR::train hands it every thread's counters after each batch
+/// (between the parallel region and the discount, so nothing is contended), and once interval_seconds have
+/// passed since the last report it emits the rates over that window.
+/// @note Reports can only be emitted between batches, so the interval is rounded up to the next batch.
+class Telemetry{
+
+public:
+    Telemetry(const TelemetryParams& params, size_t num_threads);
+
+    /// @brief Adds one batch to the current window and reports if the interval has passed.
+    /// Fills in the wait_seconds of each thread's stats.
+    void record_batch(std::vector<ThreadStats>& batch, double batch_seconds, double discount_seconds, int cur_iter);
+
+    /// @brief Reports whatever was recorded since the last report.
+    void flush(int cur_iter);
+
+private:
+    using steady = std::chrono::steady_clock;
+
+    void emit(int cur_iter);
+
+    TelemetryParams params;
+    std::ofstream out;
+    steady::time_point start;
+    steady::time_point window_start;
+    std::vector<ThreadStats> window;
+    double window_discount_seconds = 0.0;
+    uint64_t window_batches = 0;
+};
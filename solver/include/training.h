@@ -6,6 +6,9 @@
 #include "card_buckets.h"
 #include "cfr.h"
 #include "info_sets.h"
+#include "telemetry.h"
+#include "numa_placement.h"
+#include "huge_pages.h"
 
 struct TrainParams {            
     size_t train_iters;
@@ -13,11 +16,17 @@ struct TrainParams {
     size_t num_threads = 1;
     size_t omp_chunk_sz = 1;
     uint32_t base_seed = 0;
+    size_t visit_sample_every = 0; // count infoset visits every this many iterations, 0 disables
+    TelemetryParams telemetry;
+    SchedulerParams scheduler;
+    numa::NumaParams numa;
+    huge_pages::Mode huge_pages = huge_pages::Mode::off; // set before the tables are built, see huge_pages.h
 };
 
 struct ReportParams{
     std::optional<std::filesystem::path> preflop_path;
     std::optional<ISetsPaths> isets_paths;
+    std::optional<std::filesystem::path> visit_report_path;
     bool overwrite_isets = false; //gives permission to overwrite isets
     bool overwrite_preflop = false; //gives permission to overwrite preflops
 };
@@ -37,9 +46,16 @@ void write_preflop_csv(const std::string& path, const CFR& cfr);
 
 void generate_report(const ReportParams& report, const CFR& cfr);
 
+/// @brief Checks the configs against each other, so a mistake fails before training instead of after it.
+/// @throws std::runtime_error if the visit report is enabled but no visits will be counted or loaded
+void check_configs(const CFRSpec& spec, const TrainParams& train, const ReportParams& report);
+
+/// @brief Prints the page size each big table actually got (see huge_pages.h).
+void print_page_report(std::ostream& out, const CFR& cfr);
+
 void run_training(const CFRSpec& spec, const TrainParams& tp);
 
-TrainParams load_train_config(const std::filesystem::path& run_toml_path);
+TrainParams load_train_config(const std::filesystem::path& run_toml_path, const std::filesystem::path& root);
 
 ReportParams load_report_config(const std::filesystem::path& report_toml_path, const std::filesystem::path& root);
 
@@ -0,0 +1,12 @@
+#pragma once
+#include <filesystem>
+#include "training.h"
+
+/// @brief Auto-tuning of num_threads, omp_chunk_sz and iters_per_discount, run by `train tune`.
+/// Times short training runs on the abstraction in spec, one parameter at a time (threads, then chunk size,
+/// then discount cadence, each around the fastest values so far), and writes in_toml with the fastest values
+/// to out_toml. Every run starts from zeroed infosets with train.base_seed, so the runs are comparable.
+/// Runs that would not fit in what is left of budget_seconds are skipped.
+/// @throws std::runtime_error if in_toml can not be read or out_toml can not be written
+void run_tuner(const CFRSpec& spec, const TrainParams& train, double budget_seconds,
+    const std::filesystem::path& in_toml, const std::filesystem::path& out_toml);
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include "cfr.h"
+
+/// @brief Writes a plain text summary of the sampled infoset visit counts of cfr to path.
+/// Breaks the rows and visits down by street, by node depth and by the action (bet size) leading into the node,
+/// and lists the max_listed least visited nodes (never visited first, then by visits per row), with their
+/// action paths from the root.
+/// @throws std::runtime_error if cfr has no visit counts (train with visit counting on, or load them with the isets)
+void write_visit_report(const std::string& path, const CFR& cfr, size_t max_listed = 25);
@@ -18,7 +18,7 @@ int ActionTree::raise_to_x_pot(double x, const PokerState& state) const {
     int cur_bet = std::max(my_pip, opp_pip);
     int raise_to  = cur_bet + static_cast<int>(std::llround(x * pot_after));
 
-    int min_raise_to = cur_bet + std::max(state.big_blind, to_call);
+    int min_raise_to = cur_bet + std::max(state.big_blind(), to_call);
     int max_raise_to = std::min(state.pips[0] + state.stacks[0], state.pips[1] + state.stacks[1]);
 
     if (raise_to < min_raise_to) raise_to = min_raise_to;
@@ -26,6 +26,17 @@ int ActionTree::raise_to_x_pot(double x, const PokerState& state) const {
     return raise_to;
 }
 
+int ActionTree::bet_size_idx(const Action& action, const PokerState& state) const {
+    if (action.type != 3) return -1;
+
+    //get_actions keeps the first bet size producing each amount
+    const std::vector<float>& sizes = bet_sizes[state.get_street()];
+    for (size_t i = 0; i < sizes.size(); ++i){
+        if (raise_to_x_pot(sizes[i], state) == action.amt) return static_cast<int>(i);
+    }
+    return -1;
+}
+
 std::vector<Action> ActionTree::get_actions(const PokerState& state){
 
     std::vector<Action> output = {
@@ -67,7 +78,8 @@ PublicState ActionTree::get_public_state(const PokerState& state){
         .active_player = state.active_player,
         .payoffs = {state.get_payoff(0), state.get_payoff(1)},
         .folded = state.player_folded(),
-        .edge_labels = {}
+        .edge_labels = {},
+        .edge_bet_idxs = {}
     };
 
     return pub_state;
@@ -126,7 +138,7 @@ ActionTree::ActionTree(const PokerState& root_state, const std::vector<std::vect
     nodes.push_back(TreeNode{0, 0, {}});
     pub_states.push_back(get_public_state(root_state));
 
-    std::vector<std::pair<PokerState, size_t>> stack;  // (state, node idx)
+    std::vector<std::pair<PokerState, NodeIdx>> stack;  // (state, node idx)
     stack.push_back({root_state, root_idx});
 
     while (!stack.empty()) {
@@ -145,10 +157,11 @@ ActionTree::ActionTree(const PokerState& root_state, const std::vector<std::vect
         for (const Action& action : get_legal_actions(state)) {
 
             PokerState child = state.apply_action(action);
-            size_t child_idx = nodes.size();
+            NodeIdx child_idx = checked_index<NodeIdx>(nodes.size(), "action tree node");
 
             nodes[node_idx].child_idxs.push_back(child_idx);
             pub_states[node_idx].edge_labels.push_back(action);
+            pub_states[node_idx].edge_bet_idxs.push_back(bet_size_idx(action, state));
 
             nodes.push_back(TreeNode{child_idx, node_idx, {}});
             pub_states.push_back(get_public_state(child));
@@ -1,15 +1,25 @@
 #include "info_sets.h"
 #include "card_buckets.h"
 #include "cfr.h"    
+#include "perf_counters.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <omp.h>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <vector>
 #include <array>
 #include <iostream>
 
+namespace {
+    using steady = std::chrono::steady_clock;
+    double seconds_since(steady::time_point t){ return std::chrono::duration<double>(steady::now() - t).count(); }
+}
+
 CFR::CFR(CardBuckets buckets, ActionTree at):
     card_buckets(std::move(buckets)),
     action_tree(std::move(at)),
@@ -18,13 +28,49 @@ CFR::CFR(CardBuckets buckets, ActionTree at):
 CFR::CFR(InfoSets isets, CardBuckets buckets, ActionTree at):
     card_buckets(std::move(buckets)),
     action_tree(std::move(at)),
-    infosets(std::move(isets)){}
+    infosets(std::move(isets)){
+
+    if (!infosets.visits.empty()) infosets.init_visits(action_tree, card_buckets.cluster_counts);
+}
+
+void CFR::set_numa(const numa::NumaParams& params){
+    numa_params = params;
+    topology = numa::read_topology();
+    numa::place(infosets.regret_sum.data(), infosets.regret_sum.size() * sizeof(double), topology, params.placement);
+    numa::place(infosets.strategy_sum.data(), infosets.strategy_sum.size() * sizeof(double), topology, params.placement);
+}
+
+void CFR::reset(){
+    std::ranges::fill(infosets.regret_sum, 0.0);
+    std::ranges::fill(infosets.strategy_sum, 0.0);
+    std::ranges::fill(infosets.visits, uint32_t{0});
+    infosets.cur_iter = 0;
+    infosets.last_discount_iter = 0;
+    totals = {};
+}
+
+Scheduler parse_scheduler(const std::string& name){
+    if (name == "for") return Scheduler::omp_for;
+    if (name == "tasks") return Scheduler::tasks;
+    if (name == "epochs") return Scheduler::epochs;
+    throw std::runtime_error("unknown scheduler \"" + name + "\", expected for, tasks or epochs");
+}
+
+std::string to_string(Scheduler scheduler){
+    switch (scheduler){
+        case Scheduler::omp_for: return "for";
+        case Scheduler::tasks: return "tasks";
+        case Scheduler::epochs: return "epochs";
+    }
+    return "unknown";
+}
 
 InfoKey CFR::get_InfoKey(size_t node_idx, const ActionTree& at, const Dealer& d) const {
     size_t num_children = at.num_children(node_idx);
     int street = at.street(node_idx);
     int hand_id = d.get_card_id(at.active_player(node_idx), street);
-    return {node_idx, (size_t)card_buckets.cluster_of(street, hand_id), num_children};
+    return {static_cast<NodeIdx>(node_idx), static_cast<ClusterIdx>(card_buckets.cluster_of(street, hand_id)),
+        static_cast<ActionCount>(num_children)};
 }
 
 
@@ -52,10 +98,13 @@ double CFR::get_reward(const Dealer& dealer, size_t node_idx, int player){
     return 0.0;
 }
 
-double CFR::traverse(int player, size_t node_idx, size_t depth, ThreadBuff& buff) {
+double CFR::traverse(int player, size_t node_idx, size_t depth, const Dealer& dealer, ThreadBuff& buff) {
+
+    ++buff.stats.nodes[action_tree.street(node_idx)];
 
     if (action_tree.is_terminal(node_idx)) {
-        return get_reward(buff.dealer, node_idx, player);
+        ++buff.stats.terminal_evals;
+        return get_reward(dealer, node_idx, player);
     }
 
     int active_player = action_tree.active_player(node_idx);
@@ -64,13 +113,14 @@ double CFR::traverse(int player, size_t node_idx, size_t depth, ThreadBuff& buff
 
         std::vector<double>&probs = buff.probs_scratch[depth];
 
-        InfoKey ikey = get_InfoKey(node_idx, action_tree, buff.dealer);
+        InfoKey ikey = get_InfoKey(node_idx, action_tree, dealer);
+        if (buff.count_visits) infosets.count_visit(ikey);
         infosets.get_regret_strategy(ikey, probs);
-        infosets.update_strategy(ikey, probs); 
+        infosets.update_strategy(ikey, probs, buff.weight); 
 
         size_t action_idx = infosets.sample_action_idx(buff.rng, probs);
         size_t child_idx = action_tree.apply_action(node_idx, action_idx);
-        double util = traverse(player, child_idx, depth + 1, buff);
+        double util = traverse(player, child_idx, depth + 1, dealer, buff);
 
         return util;
     }
@@ -79,24 +129,53 @@ double CFR::traverse(int player, size_t node_idx, size_t depth, ThreadBuff& buff
     std::vector<double>& probs = buff.probs_scratch[depth];
     std::vector<double>& action_deltas = buff.deltas_scratch[depth];
 
-    InfoKey ikey = get_InfoKey(node_idx, action_tree, buff.dealer);
+    InfoKey ikey = get_InfoKey(node_idx, action_tree, dealer);
+    if (buff.count_visits) infosets.count_visit(ikey);
     infosets.get_regret_strategy(ikey, probs);
     action_deltas.assign(ikey.num_actions, 0.0);
     double node_util = 0.0;
 
-    for (size_t i = 0; i < ikey.num_actions; i++) {
+    if (task_buffs && depth < scheduler_params.task_depth) {
+        // Each subtree runs on whichever thread picks it up, with that thread's buffer. Tasks are tied, so this
+        // thread only runs descendants of this frame until the taskwait: they use deeper scratch levels, and
+        // dealer and action_deltas stay put for the children to read and write.
+        const Dealer* deal = &dealer;
+        double* utils = action_deltas.data();
+        bool count_visits = buff.count_visits;
+        double weight = buff.weight;
+
+        for (size_t i = 0; i < ikey.num_actions; i++) {
+            size_t child_idx = action_tree.apply_action(node_idx, i);
+
+            #pragma omp task firstprivate(i, child_idx, deal, utils, count_visits, weight)
+            {
+                ThreadBuff& task_buff = (*task_buffs)[omp_get_thread_num()];
+                task_buff.count_visits = count_visits;
+                task_buff.weight = weight;
+                steady::time_point start = steady::now();
+                utils[i] = traverse(player, child_idx, depth + 1, *deal, task_buff);
+                if (!task_buff.traversing) task_buff.stats.traverse_seconds += seconds_since(start);
+            }
+        }
+        #pragma omp taskwait
 
-        size_t child_idx = action_tree.apply_action(node_idx, i);
-        double action_util = traverse(player, child_idx, depth + 1, buff);
-        node_util += probs[i] * action_util;
-        action_deltas[i] = action_util;
+        for (size_t i = 0; i < ikey.num_actions; i++) node_util += probs[i] * action_deltas[i];
+    }
+    else {
+        for (size_t i = 0; i < ikey.num_actions; i++) {
+
+            size_t child_idx = action_tree.apply_action(node_idx, i);
+            double action_util = traverse(player, child_idx, depth + 1, dealer, buff);
+            node_util += probs[i] * action_util;
+            action_deltas[i] = action_util;
+        }
     }
 
     for (size_t i = 0; i < action_deltas.size(); ++i) {
         action_deltas[i] = action_deltas[i] - node_util;
     }
 
-    infosets.update_regret(ikey, action_deltas);
+    infosets.update_regret(ikey, action_deltas, buff.weight);
     return node_util;
 }
 
@@ -117,30 +196,170 @@ std::vector<ThreadBuff> CFR::make_thread_buffs(size_t num_threads, uint32_t base
     return output;
 }
 
+void CFR::run_iteration(size_t iter, size_t visit_sample_every, ThreadBuff& buff){
+
+    // sampled by iteration index rather than the rng, so counting does not change the training run
+    buff.count_visits = visit_sample_every > 0 && iter % visit_sample_every == 0;
+    buff.traversing = true;
+    steady::time_point deal_start = steady::now();
+    {
+        PERF_REGION("deal");
+        buff.dealer.deal(buff.rng);
+    }
+    steady::time_point traverse_start = steady::now();
+    {
+        PERF_REGION("traverse");
+        traverse(0, action_tree.root_idx, 0, buff.dealer, buff);
+        traverse(1, action_tree.root_idx, 0, buff.dealer, buff);
+    }
+
+    buff.stats.deal_seconds += std::chrono::duration<double>(traverse_start - deal_start).count();
+    buff.stats.traverse_seconds += seconds_since(traverse_start);
+    ++buff.stats.iters;
+    buff.traversing = false;
+}
+
 void CFR::train(size_t iters, size_t iters_per_discount, 
-    size_t num_threads, size_t omp_chunk_sz, uint32_t base_seed) {
+    size_t num_threads, size_t omp_chunk_sz, uint32_t base_seed,
+    size_t visit_sample_every, const TelemetryParams& telemetry_params) {
 
     std::vector<ThreadBuff> thread_buffs = make_thread_buffs(num_threads, base_seed);
+    std::vector<int> thread_cpus = numa::thread_cpus(topology, numa_params.affinity, num_threads);
+    numa::ScopedAffinity restore_affinity; // the calling thread is thread 0 of every team below
+    std::vector<ThreadStats> batch_stats(num_threads);
+    Telemetry telemetry(telemetry_params, num_threads);
     size_t done = 0;
 
-    while (done < iters) {
-        
-        const size_t batch= std::min(iters_per_discount, iters - done);
+    if (visit_sample_every > 0 && infosets.visits.empty()) infosets.init_visits(action_tree, card_buckets.cluster_counts);
 
-        #pragma omp parallel num_threads(num_threads)
+    auto end_batch = [&](size_t batch, steady::time_point batch_start){
+        double batch_seconds = seconds_since(batch_start);
+
+        done += batch;
+        infosets.cur_iter += batch;
+        steady::time_point discount_start = steady::now();
         {
-            ThreadBuff& buff = thread_buffs[omp_get_thread_num()];
+            PERF_REGION("discount");
+            infosets.discount(infosets.cur_iter);   
+        }
+        double discount_seconds = seconds_since(discount_start);
+
+        for (size_t t = 0; t < num_threads; ++t){
+            batch_stats[t] = thread_buffs[t].stats;
+            thread_buffs[t].stats = {};
+        }
+        telemetry.record_batch(batch_stats, batch_seconds, discount_seconds, infosets.cur_iter);
+        for (const ThreadStats& stats : batch_stats) totals += stats;
+    };
+
+    if (scheduler_params.scheduler == Scheduler::epochs && iters > 0) {
+
+        // Discounting at t multiplies the tables by (last_discount_iter + 1) / (t + 1), so by the start of epoch k
+        // they would have been scaled by (last + 1) / (t_k + 1) in total. Epoch k's updates are weighted by the
+        // inverse instead, and the one discount at the end applies the total.
+        const size_t num_epochs = (iters + iters_per_discount - 1) / iters_per_discount;
+        const size_t first_iter = static_cast<size_t>(infosets.cur_iter);
+        std::vector<double> epoch_weights(num_epochs, 1.0);
+        for (size_t k = 1; k < num_epochs; ++k)
+            epoch_weights[k] = double(first_iter + k * iters_per_discount + 1) / double(infosets.last_discount_iter + 1);
+
+        std::atomic<size_t> next_iter{0};
+        std::atomic<size_t> reported_epoch{0};
+        std::mutex stats_mutex; // guards published, telemetry and window_start
+        std::vector<ThreadStats> published(num_threads); // each thread's stats since the last report
+        steady::time_point window_start = steady::now();
+
+        auto report = [&](size_t epoch){
+            batch_stats = published;
+            published.assign(num_threads, {});
+            telemetry.record_batch(batch_stats, seconds_since(window_start), 0.0,
+                static_cast<int>(first_iter + epoch * iters_per_discount));
+            for (const ThreadStats& stats : batch_stats) totals += stats;
+            window_start = steady::now();
+        };
 
-            #pragma omp for schedule(dynamic, omp_chunk_sz)
-            for (size_t i = 0; i <  batch; ++i) {
-                buff.dealer.deal(buff.rng);
-                traverse(0, action_tree.root_idx, 0, buff);
-                traverse(1, action_tree.root_idx, 0, buff);
+        #pragma omp parallel num_threads(num_threads)
+        {
+            const size_t thread = static_cast<size_t>(omp_get_thread_num());
+            ThreadBuff& buff = thread_buffs[thread];
+            if (!thread_cpus.empty()) numa::pin_this_thread(thread_cpus[thread]);
+
+            while (true) {
+                size_t first = next_iter.fetch_add(omp_chunk_sz, std::memory_order_relaxed);
+                if (first >= iters) break;
+                size_t last = std::min(first + omp_chunk_sz, iters);
+
+                for (size_t i = first; i < last; ++i) {
+                    buff.weight = epoch_weights[i / iters_per_discount];
+                    run_iteration(i, visit_sample_every, buff);
+                }
+
+                // the first thread to claim work in a new epoch reports the previous one
+                size_t epoch = last / iters_per_discount;
+                size_t seen = reported_epoch.load(std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                published[thread] += buff.stats;
+                buff.stats = {};
+                if (epoch > seen && epoch < num_epochs && reported_epoch.compare_exchange_strong(seen, epoch)) report(epoch);
             }
         }
 
-        done += batch;
-        infosets.cur_iter += batch;
-        infosets.discount(infosets.cur_iter);   
+        for (ThreadBuff& buff : thread_buffs) buff.weight = 1.0;
+        infosets.cur_iter += static_cast<int>(iters);
+        steady::time_point discount_start = steady::now();
+        {
+            PERF_REGION("discount");
+            infosets.discount(infosets.cur_iter);
+        }
+        double discount_seconds = seconds_since(discount_start);
+
+        batch_stats = published;
+        telemetry.record_batch(batch_stats, seconds_since(window_start), discount_seconds, infosets.cur_iter);
+        for (const ThreadStats& stats : batch_stats) totals += stats;
+    }
+    else if (scheduler_params.scheduler == Scheduler::tasks) {
+        task_buffs = &thread_buffs;
+
+        // one team for the whole call. A batch ends when its taskloop has no tasks left, and the threads
+        // waiting at the single steal subtree tasks meanwhile, then the discount's tasks.
+        #pragma omp parallel num_threads(num_threads)
+        {
+            if (!thread_cpus.empty()) numa::pin_this_thread(thread_cpus[omp_get_thread_num()]);
+
+            #pragma omp single
+            while (done < iters) {
+                const size_t batch = std::min(iters_per_discount, iters - done);
+                steady::time_point batch_start = steady::now();
+
+                #pragma omp taskloop grainsize(omp_chunk_sz)
+                for (size_t i = 0; i < batch; ++i) {
+                    run_iteration(done + i, visit_sample_every, thread_buffs[omp_get_thread_num()]);
+                }
+                end_batch(batch, batch_start);
+            }
+        }
+        task_buffs = nullptr;
     }
-}
\ No newline at end of file
+    else {
+        while (done < iters) {
+        
+            const size_t batch= std::min(iters_per_discount, iters - done);
+            steady::time_point batch_start = steady::now();
+
+            #pragma omp parallel num_threads(num_threads)
+            {
+                ThreadBuff& buff = thread_buffs[omp_get_thread_num()];
+                // every batch, as the runtime is free to hand the team different OS threads
+                if (!thread_cpus.empty()) numa::pin_this_thread(thread_cpus[omp_get_thread_num()]);
+
+                #pragma omp for schedule(dynamic, omp_chunk_sz)
+                for (size_t i = 0; i <  batch; ++i) {
+                    run_iteration(done + i, visit_sample_every, buff);
+                }
+            }
+            end_batch(batch, batch_start);
+        }
+    }
+
+    telemetry.flush(infosets.cur_iter);
+}
@@ -10,6 +10,7 @@
 InfoSets::InfoSets(const ActionTree& action_tree, const std::vector<size_t>& cluster_counts) {
 
     size_t cum_total = 0;
+    offsets.reserve(action_tree.pub_states.size());
 
     for (const PublicState& pub_state : action_tree.pub_states){
 
@@ -18,7 +19,7 @@ InfoSets::InfoSets(const ActionTree& action_tree, const std::vector<size_t>& clu
         offsets.push_back(cum_total);
 
         if (num_actions != 0){
-            size_t num_clusters = cluster_counts[st];
+            size_t num_clusters = checked_index<ClusterIdx>(cluster_counts[st], "cluster count");
             cum_total += num_actions*num_clusters;
         }
     }
@@ -33,14 +34,19 @@ InfoSets::InfoSets(const ISetsPaths& paths) {
     if (iter_info.size() != 2) throw std::runtime_error("The iter_info vector should have size 2");
     last_discount_iter = iter_info[0]; cur_iter = iter_info[1];
 
-    auto [loaded_regret, regret_header] = load_matrix_and_header<double>(paths.regret_path);
+    auto [loaded_regret, regret_header] = load_matrix_and_header<double, HugePageAllocator<double>>(paths.regret_path);
     regret_sum = std::move(loaded_regret);
 
-    auto [loaded_strategy, strategy_header] = load_matrix_and_header<double>(paths.strategy_path);
+    auto [loaded_strategy, strategy_header] = load_matrix_and_header<double, HugePageAllocator<double>>(paths.strategy_path);
     strategy_sum = std::move(loaded_strategy);
 
     auto [loaded_offsets, offset_header] = load_matrix_and_header<size_t>(paths.offset_path);
-    offsets = std::move(loaded_offsets);
+    offsets = PackedOffsets{loaded_offsets};
+
+    if (!paths.visits_path.empty() && std::filesystem::exists(paths.visits_path)){
+        auto [loaded_visits, visits_header] = load_matrix_and_header<uint32_t>(paths.visits_path);
+        visits = std::move(loaded_visits);
+    }
 }
 
 void InfoSets::write_ckpt(const ISetsPaths& paths) const{
@@ -71,7 +77,7 @@ void InfoSets::write_ckpt(const ISetsPaths& paths) const{
         .is_signed = false,
         .is_float = false
     };
-    write_matrix_and_header(paths.offset_path, offset_header, offsets);
+    write_matrix_and_header(paths.offset_path, offset_header, offsets.unpack());
 
     MatrixHeader iter_info_header{
         .num_rows = 2,
@@ -82,9 +88,35 @@ void InfoSets::write_ckpt(const ISetsPaths& paths) const{
     };
     std::vector<int> temp_vec = {last_discount_iter, cur_iter};
     write_matrix_and_header(paths.iters_path, iter_info_header, temp_vec);
+
+    if (!paths.visits_path.empty() && !visits.empty()){
+        MatrixHeader visits_header{
+            .num_rows = visits.size(),
+            .num_cols = 1,
+            .bytes_per_elt = sizeof(uint32_t),
+            .is_signed = false,
+            .is_float = false
+        };
+        write_matrix_and_header(paths.visits_path, visits_header, visits);
+    }
+}
+
+void InfoSets::init_visits(const ActionTree& action_tree, const std::vector<size_t>& cluster_counts){
+
+    row_offsets = PackedOffsets{};
+    row_offsets.reserve(action_tree.pub_states.size());
+    size_t num_rows = 0;
+
+    for (const PublicState& pub_state : action_tree.pub_states){
+        row_offsets.push_back(num_rows);
+        if (!pub_state.edge_labels.empty()) num_rows += cluster_counts[pub_state.street_idx];
+    }
+
+    if (visits.empty()) visits.assign(num_rows, 0);
+    else if (visits.size() != num_rows) throw std::runtime_error("the loaded visit counts do not match the action tree");
 }
 
-void InfoSets::update_regret(const InfoKey& ikey, const std::vector<double>& action_deltas) {
+void InfoSets::update_regret(const InfoKey& ikey, const std::vector<double>& action_deltas, double weight) {
 
     size_t offset = get_offset(ikey);
     size_t n = ikey.num_actions;
@@ -94,18 +126,18 @@ void InfoSets::update_regret(const InfoKey& ikey, const std::vector<double>& act
     }
 
     for (size_t i = 0; i < n; i++) {
-        regret_sum[offset+i] += action_deltas[i];  
+        regret_sum[offset+i] += weight * action_deltas[i];  
     }
 }
 
-void InfoSets::update_strategy(const InfoKey& ikey , std::vector<double>& cur_strat) {
+void InfoSets::update_strategy(const InfoKey& ikey , std::vector<double>& cur_strat, double weight) {
 
     size_t offset = get_offset(ikey);
 
     if (ikey.num_actions != cur_strat.size()) throw std::logic_error("size mismatch");
 
     for (size_t i = 0; i < ikey.num_actions; i++) {
-        strategy_sum[offset+i] += cur_strat[i];
+        strategy_sum[offset+i] += weight * cur_strat[i];
     }
 }
 
@@ -169,7 +201,12 @@ void InfoSets::discount(int t) {
     if (t <= last_discount_iter) throw std::runtime_error("discount: t must exceed last_discounter_iter");
 
     double f = double(last_discount_iter + 1) / double(t + 1);
-    for (double& r : regret_sum)   r *= f;
-    for (double& s : strategy_sum) s *= f;
+
+    // taskloops, so that inside a parallel region (the tasks scheduler) the waiting threads take part.
+    // Outside of one the encountering thread runs them all.
+    #pragma omp taskloop grainsize(1 << 16)
+    for (size_t i = 0; i < regret_sum.size(); ++i) regret_sum[i] *= f;
+    #pragma omp taskloop grainsize(1 << 16)
+    for (size_t i = 0; i < strategy_sum.size(); ++i) strategy_sum[i] *= f;
     last_discount_iter = t;
 }
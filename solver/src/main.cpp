@@ -1,12 +1,20 @@
 #include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <string>
+#include "planner.h"
+#include "tuner.h"
 #include "training.h"
+#include "perf_counters.h"
 
 namespace fs = std::filesystem;
 using steady = std::chrono::steady_clock;
 
-int main(int , char** argv) {
+/// train                 trains with configs/{cfr,train,report}.toml
+/// train plan [s]        prints the memory and time needed for that, calibrating for s seconds (default 10)
+/// train tune [s] [out]  times thread counts, chunk sizes and discount cadences for about s seconds (default 300)
+///                       and writes train.toml with the fastest ones to out (default configs/train.tuned.toml)
+int main(int argc, char** argv) {
     fs::path exe  = fs::weakly_canonical(fs::path(argv[0]));
     fs::path root = exe.parent_path().parent_path();
 
@@ -16,12 +24,31 @@ int main(int , char** argv) {
 
     CFRSpec spec = load_cfr_config(cfr_path, root); 
     ReportParams report = load_report_config(report_path, root);
-    TrainParams train = load_train_config(run_path);
+    TrainParams train = load_train_config(run_path, root);
+    check_configs(spec, train, report);
+    huge_pages::set_mode(train.huge_pages);
+
+    if (argc >= 2 && std::string(argv[1]) == "plan") {
+        double calibration_seconds = argc >= 3 ? std::stod(argv[2]) : 10.0;
+        run_planner(spec, train, calibration_seconds);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "tune") {
+        double budget_seconds = argc >= 3 ? std::stod(argv[2]) : 300.0;
+        fs::path out_path = argc >= 4 ? fs::path(argv[3]) : root / "configs/train.tuned.toml";
+        run_tuner(spec, train, budget_seconds, run_path, out_path);
+        return 0;
+    }
+
     CFR cfr = load_spec(std::move(spec));
+    cfr.set_numa(train.numa);
+    cfr.set_scheduler(train.scheduler);
+    print_page_report(std::cout, cfr);
 
     steady::time_point start = steady::now();
     cfr.train(train.train_iters, train.iters_per_discount, train.num_threads,
-        train.omp_chunk_sz, train.base_seed);
+        train.omp_chunk_sz, train.base_seed, train.visit_sample_every, train.telemetry);
     steady::time_point finish = steady::now();
 
     std::cout << "Trained in "
@@ -29,5 +56,6 @@ int main(int , char** argv) {
          << " seconds\n";
 
     generate_report(report, cfr);
+    PERF_REPORT(std::cout);
     return 0;
 }
\ No newline at end of file
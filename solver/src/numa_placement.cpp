@@ -0,0 +1,208 @@
+#include "numa_placement.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace numa{
+
+namespace {
+
+    const std::array<std::string, 3> affinity_names = {"none", "compact", "spread"};
+    const std::array<std::string, 3> placement_names = {"first_touch", "interleave", "partition"};
+
+    template <class Enum, size_t N>
+    Enum parse_name(const std::array<std::string, N>& names, const std::string& name, const std::string& what){
+        auto it = std::ranges::find(names, name);
+        if (it == names.end()) throw std::runtime_error("unknown " + what + " \"" + name + "\"");
+        return static_cast<Enum>(it - names.begin());
+    }
+
+    /// @brief "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+    std::vector<int> parse_cpulist(const std::string& list){
+        std::vector<int> cpus;
+        std::stringstream in(list);
+        for (std::string range; std::getline(in, range, ',');){
+            if (range.empty() || range == "\n") continue;
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    void warn_once(bool& warned, const std::string& msg){
+        if (warned) return;
+        warned = true;
+        std::cerr << "numa: " << msg << '\n';
+    }
+
+#ifdef __linux__
+    std::vector<int> thread_affinity(){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::vector<int> cpus;
+        if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        return cpus;
+    }
+
+    bool set_thread_affinity(const std::vector<int>& cpus){
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+
+    /// @brief the cpus of the thread that asks first, which is before train pins anything. Every later
+    /// read_topology sees the same set, whichever thread calls it.
+    const std::vector<int>& allowed_cpus(){
+        static const std::vector<int> cpus = thread_affinity();
+        return cpus;
+    }
+
+    long mbind_range(void* start, size_t len, int mode, const std::vector<int>& nodes){
+        constexpr size_t bits = 8 * sizeof(unsigned long);
+        int max_node = std::ranges::max(nodes);
+        std::vector<unsigned long> mask(static_cast<size_t>(max_node) / bits + 1, 0);
+        for (int node : nodes) mask[static_cast<size_t>(node) / bits] |= 1ul << (static_cast<size_t>(node) % bits);
+        return syscall(SYS_mbind, start, len, mode, mask.data(), mask.size() * bits + 1, MPOL_MF_MOVE);
+    }
+#endif
+}
+
+Affinity parse_affinity(const std::string& name){ return parse_name<Affinity>(affinity_names, name, "numa affinity"); }
+Placement parse_placement(const std::string& name){ return parse_name<Placement>(placement_names, name, "numa placement"); }
+std::string to_string(Affinity affinity){ return affinity_names[static_cast<size_t>(affinity)]; }
+std::string to_string(Placement placement){ return placement_names[static_cast<size_t>(placement)]; }
+
+Topology read_topology(){
+    Topology topology;
+
+#ifdef __linux__
+    const std::vector<int>& allowed = allowed_cpus();
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator("/sys/devices/system/node", ec)){
+        std::string name = entry.path().filename().string();
+        if (!name.starts_with("node") || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4]))) continue;
+
+        std::ifstream in(entry.path() / "cpulist");
+        std::string list;
+        std::getline(in, list);
+        std::vector<int> cpus;
+        for (int cpu : parse_cpulist(list))
+            if (std::ranges::find(allowed, cpu) != allowed.end()) cpus.push_back(cpu);
+        if (cpus.empty()) continue; // memory only nodes, or none of its cpus are ours
+
+        topology.node_ids.push_back(std::stoi(name.substr(4)));
+        topology.node_cpus.push_back(std::move(cpus));
+    }
+
+    // directory order is not sorted
+    std::vector<size_t> order(topology.node_ids.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::ranges::sort(order, {}, [&](size_t i){ return topology.node_ids[i]; });
+    Topology sorted;
+    for (size_t i : order){
+        sorted.node_ids.push_back(topology.node_ids[i]);
+        sorted.node_cpus.push_back(topology.node_cpus[i]);
+    }
+    topology = std::move(sorted);
+
+    if (topology.node_ids.empty() && !allowed.empty()) topology = {{0}, {allowed}};
+#endif
+
+    if (topology.node_ids.empty()){
+        std::vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+        for (size_t i = 0; i < cpus.size(); ++i) cpus[i] = static_cast<int>(i);
+        topology = {{0}, {cpus}};
+    }
+    return topology;
+}
+
+std::vector<int> thread_cpus(const Topology& topology, Affinity affinity, size_t num_threads){
+    std::vector<int> cpus;
+    if (affinity == Affinity::none) return cpus;
+
+    if (affinity == Affinity::compact){
+        std::vector<int> all;
+        for (const std::vector<int>& node : topology.node_cpus) all.insert(all.end(), node.begin(), node.end());
+        for (size_t i = 0; i < num_threads; ++i) cpus.push_back(all[i % all.size()]);
+        return cpus;
+    }
+
+    size_t nodes = topology.num_nodes();
+    for (size_t i = 0; i < num_threads; ++i){
+        const std::vector<int>& node = topology.node_cpus[i % nodes];
+        cpus.push_back(node[(i / nodes) % node.size()]);
+    }
+    return cpus;
+}
+
+void pin_this_thread(int cpu){
+#ifdef __linux__
+    if (set_thread_affinity({cpu})) return;
+#endif
+    static bool warned = false;
+    warn_once(warned, "could not pin threads, they are left to the OS");
+}
+
+ScopedAffinity::ScopedAffinity(){
+#ifdef __linux__
+    saved = thread_affinity();
+#endif
+}
+
+ScopedAffinity::~ScopedAffinity(){
+#ifdef __linux__
+    if (!saved.empty()) set_thread_affinity(saved);
+#endif
+}
+
+void place(void* data, size_t bytes, const Topology& topology, Placement placement){
+    if (placement == Placement::first_touch || topology.num_nodes() < 2 || bytes == 0) return;
+
+#ifdef __linux__
+    // whole pages only, the partial pages at the ends stay where they are
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t first = (reinterpret_cast<uintptr_t>(data) + page - 1) / page * page;
+    uintptr_t last = (reinterpret_cast<uintptr_t>(data) + bytes) / page * page;
+    if (last <= first) return;
+
+    bool ok = true;
+    if (placement == Placement::interleave){
+        ok = mbind_range(reinterpret_cast<void*>(first), last - first, MPOL_INTERLEAVE, topology.node_ids) == 0;
+    }
+    else {
+        size_t pages = (last - first) / page;
+        size_t nodes = topology.num_nodes();
+        for (size_t n = 0; n < nodes && ok; ++n){
+            uintptr_t begin = first + pages * n / nodes * page;
+            uintptr_t end = first + pages * (n + 1) / nodes * page;
+            if (end > begin) ok = mbind_range(reinterpret_cast<void*>(begin), end - begin, MPOL_BIND, {topology.node_ids[n]}) == 0;
+        }
+    }
+    if (ok) return;
+#endif
+    static bool warned = false;
+    warn_once(warned, "could not place the infoset pages, they stay where they were first touched");
+}
+
+}
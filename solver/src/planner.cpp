@@ -0,0 +1,159 @@
+#include "planner.h"
+#include "action_tree.h"
+#include "card_buckets.h"
+#include "cfr.h"
+#include "poker_state.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+    using steady = std::chrono::steady_clock;
+
+    const std::array<std::string, 4> street_names = {"preflop", "flop", "turn", "river"};
+
+    struct StreetSize{
+        size_t decision_nodes = 0;
+        size_t rows = 0; // (node, cluster) infosets
+        size_t entries = 0; // regret_sum (and strategy_sum) entries, one per (node, cluster, action)
+    };
+
+    std::string format_bytes(double bytes){
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        if (bytes >= double(1ull << 30)) out << bytes / double(1ull << 30) << " GB";
+        else out << bytes / double(1ull << 20) << " MB";
+        return out.str();
+    }
+
+    std::string format_duration(double seconds){
+        uint64_t s = static_cast<uint64_t>(seconds);
+        std::ostringstream out;
+        if (s >= 86400) out << s / 86400 << "d ";
+        if (s >= 3600) out << (s % 86400) / 3600 << "h ";
+        out << (s % 3600) / 60 << "m " << s % 60 << "s";
+        return out.str();
+    }
+
+    void print_line(const std::string& label, const std::string& value){
+        std::cout << "  " << std::left << std::setw(38) << label << std::right << value << '\n';
+    }
+
+    double physical_memory_bytes(){
+        return static_cast<double>(sysconf(_SC_PHYS_PAGES)) * static_cast<double>(sysconf(_SC_PAGESIZE));
+    }
+}
+
+void run_planner(const CFRSpec& spec, const TrainParams& train, double calibration_seconds){
+
+    // the calibration batches are min(iters_per_discount, train_iters) long
+    if (train.train_iters == 0 || train.iters_per_discount == 0)
+        throw std::runtime_error("plan needs positive train_iters and iters_per_discount");
+
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
+    ActionTree action_tree{init_state, spec.bet_sizes};
+    CardBuckets buckets{spec.bucket_paths};
+    const std::vector<size_t>& clusters = buckets.cluster_counts;
+
+    // terminal nodes are past the last street (street_idx 4) and hold no infosets
+    std::array<StreetSize, 4> streets;
+    size_t num_edges = 0;
+    size_t terminal_nodes = 0;
+    for (size_t node = 0; node < action_tree.nodes.size(); ++node){
+        if (action_tree.is_terminal(node)) { ++terminal_nodes; continue; }
+        int street = action_tree.street(node);
+        StreetSize& st = streets[street];
+        size_t children = static_cast<size_t>(action_tree.num_children(node));
+        num_edges += children;
+        ++st.decision_nodes;
+        st.rows += clusters[street];
+        st.entries += children * clusters[street];
+    }
+
+    std::cout << "action tree: " << action_tree.nodes.size() << " nodes (" << terminal_nodes << " terminal), depth " << action_tree.depth()
+        << ", max branching " << action_tree.max_branching() << '\n';
+    std::cout << "clusters: ";
+    for (size_t s = 0; s < clusters.size(); ++s) std::cout << (s ? ", " : "") << street_names[s] << ' ' << clusters[s];
+    std::cout << "\n\n";
+
+    StreetSize total;
+    std::cout << std::left << std::setw(10) << "street" << std::right << std::setw(16) << "decision nodes"
+        << std::setw(16) << "infosets" << std::setw(18) << "regret entries"
+        << std::setw(20) << "regret + strategy" << '\n';
+    for (size_t s = 0; s < streets.size(); ++s){
+        const StreetSize& st = streets[s];
+        std::cout << std::left << std::setw(10) << street_names[s] << std::right << std::setw(16) << st.decision_nodes
+            << std::setw(16) << st.rows << std::setw(18) << st.entries
+            << std::setw(20) << format_bytes(2.0 * sizeof(double) * st.entries) << '\n';
+        total.decision_nodes += st.decision_nodes;
+        total.rows += st.rows;
+        total.entries += st.entries;
+    }
+    std::cout << std::left << std::setw(10) << "total" << std::right << std::setw(16) << total.decision_nodes
+        << std::setw(16) << total.rows << std::setw(18) << total.entries
+        << std::setw(20) << format_bytes(2.0 * sizeof(double) * total.entries) << "\n\n";
+
+    double infoset_bytes = 2.0 * sizeof(double) * total.entries + PackedOffsets::bytes_per_offset * action_tree.nodes.size();
+    double visit_bytes = train.visit_sample_every > 0 ? sizeof(uint32_t) * double(total.rows) : 0.0;
+    double bucket_bytes = sizeof(int) * double(buckets.preflop_clusters.size() + buckets.flop_clusters.size()
+        + buckets.turn_clusters.size() + buckets.river_clusters.size());
+    // vectors of the tree, ignoring allocator overhead
+    double tree_bytes = double(action_tree.nodes.size()) * (sizeof(TreeNode) + sizeof(PublicState))
+        + double(num_edges) * (sizeof(NodeIdx) + sizeof(Action) + sizeof(int));
+    double total_bytes = infoset_bytes + visit_bytes + bucket_bytes + tree_bytes;
+    double physical_bytes = physical_memory_bytes();
+
+    std::cout << "memory\n";
+    print_line("infosets (regret, strategy, offsets)", format_bytes(infoset_bytes));
+    if (visit_bytes > 0) print_line("visit counts", format_bytes(visit_bytes));
+    print_line("bucket tables", format_bytes(bucket_bytes));
+    print_line("action tree (approx)", format_bytes(tree_bytes));
+    print_line("total", format_bytes(total_bytes) + " of " + format_bytes(physical_bytes) + " physical");
+    std::cout << '\n';
+
+    if (total_bytes > physical_bytes){
+        std::cout << "the abstraction does not fit in physical memory, skipping the calibration\n";
+        return;
+    }
+
+    // batches at the configured discount cadence. The first one is a warm up which pays for first touching
+    // the infoset pages, and is not counted.
+    const size_t batch = std::min(train.iters_per_discount, train.train_iters);
+    CFR cfr{std::move(buckets), std::move(action_tree)};
+    cfr.set_numa(train.numa);
+    cfr.set_scheduler(train.scheduler);
+    print_page_report(std::cout, cfr);
+    std::cout << '\n';
+    uint32_t seed = train.base_seed;
+    cfr.train(batch, batch, train.num_threads, train.omp_chunk_sz, seed++);
+
+    uint64_t first_nodes = cfr.get_nodes_visited();
+    size_t timed_iters = 0;
+    double seconds = 0.0;
+    steady::time_point start = steady::now();
+    while (seconds < calibration_seconds){
+        cfr.train(batch, batch, train.num_threads, train.omp_chunk_sz, seed++);
+        timed_iters += batch;
+        seconds = std::chrono::duration<double>(steady::now() - start).count();
+    }
+
+    double iters_per_sec = double(timed_iters) / seconds;
+    double nodes_per_sec = double(cfr.get_nodes_visited() - first_nodes) / seconds;
+
+    std::cout << "calibration: " << timed_iters << " iterations in " << std::fixed << std::setprecision(1) << seconds
+        << "s on " << train.num_threads << " threads (chunk " << train.omp_chunk_sz << ", discount every " << batch << ")\n";
+    print_line("iterations/s", std::to_string(static_cast<uint64_t>(iters_per_sec)));
+    print_line("nodes/s", std::to_string(static_cast<uint64_t>(nodes_per_sec)));
+    print_line("time to " + std::to_string(train.train_iters) + " iterations",
+        format_duration(double(train.train_iters) / iters_per_sec));
+}
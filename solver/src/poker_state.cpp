@@ -13,17 +13,15 @@
 #include <random>
 #include <utility>  
 
-PokerState::PokerState(int stack, int bb, int sb):
-    starting_stack(stack), big_blind(bb), small_blind(sb),
-    dealer(Dealer{}){
+PokerState::PokerState(Table& table): table(&table){
     stage = 0;
     active_player = 0;
 
-    stacks.fill(starting_stack);
+    stacks.fill(table.starting_stack);
     pips.fill(0);
     pot = 0;
 
-    last_action = {-1,-1};
+    last_action_type = -1;
 }
 
  std::vector<uint8_t> PokerState::get_cards(int player) const{
@@ -34,7 +32,7 @@ PokerState::PokerState(int stack, int bb, int sb):
     std::vector<uint8_t> output;
 
     for (int i = 0; i < n; ++i){
-        output.push_back(dealer.cards[player][i]);
+        output.push_back(table->dealer.cards[player][i]);
     }
     return output;
 }
@@ -55,9 +53,10 @@ PokerState::PokerState(int stack, int bb, int sb):
     }
 
             // if no one folded in the game.
-    if (dealer.winner == -1) return 0.0;
-    else if (dealer.winner == player) return get_payoff(player);
-    else if (dealer.winner == opp) return - get_payoff(opp);
+    const int winner = table->dealer.winner;
+    if (winner == -1) return 0.0;
+    else if (winner == player) return get_payoff(player);
+    else if (winner == opp) return - get_payoff(opp);
 
     throw std::runtime_error("Should not be able to get here");
     return 0.0;
@@ -69,7 +68,7 @@ std::pair<int,int> PokerState::get_raise_bounds() const{
     bool facing_bet = (to_call > 0);
 
     int cur_bet = std::max(pips[0], pips[1]);
-    int min_raise_to = cur_bet + (facing_bet ? std::max(big_blind, to_call) : big_blind);
+    int min_raise_to = cur_bet + (facing_bet ? std::max(big_blind(), to_call) : big_blind());
     int max_raise_to = std::min(pips[0] + stacks[0], pips[1] + stacks[1]);
     return {min_raise_to, max_raise_to};
 }
@@ -93,7 +92,7 @@ bool PokerState::is_legal_action(const Action& action) const {
     return (action.amt >= min_raise) && (action.amt <= max_raise);
 }
 
-PokerState PokerState::apply_action(const Action& action) {
+PokerState PokerState::apply_action(const Action& action) const {
 
     if (is_chance() || is_terminal()){
         throw std::logic_error("cant call action on chance or terminal");
@@ -110,11 +109,11 @@ PokerState PokerState::apply_action(const Action& action) {
     
     bool round_ended = false;
 
-    if (last_action.type == 3 && action.type == 2) round_ended = true; //raise then call
-    if (last_action.type == 1 && action.type == 1) round_ended = true; //check then check
-    if (last_action.type == 2 && action.type == 1) round_ended = true; //limp then check
+    if (last_action_type == 3 && action.type == 2) round_ended = true; //raise then call
+    if (last_action_type == 1 && action.type == 1) round_ended = true; //check then check
+    if (last_action_type == 2 && action.type == 1) round_ended = true; //limp then check
 
-    next.last_action = action;
+    next.last_action_type = static_cast<int8_t>(action.type);
     next.active_player = 1 - active_player; 
 
     if (action.type == 0) next.stage = 8;
@@ -122,7 +121,7 @@ PokerState PokerState::apply_action(const Action& action) {
     return next;
 }
 
-PokerState PokerState::apply_chance(std::mt19937 rng) {
+PokerState PokerState::apply_chance(std::mt19937& rng) const {
 
     PokerState next = *this;
 
@@ -130,16 +129,16 @@ PokerState PokerState::apply_chance(std::mt19937 rng) {
 
     next.pips = {0, 0};
     next.active_player = 0;
-    next.last_action = {-1, -1};
+    next.last_action_type = -1;
 
     if (stage == 0) { 
-        dealer.deal(rng);
+        table->dealer.deal(rng);
         next.active_player = 1;
-        next.pot = small_blind + big_blind;
-        next.stacks[0] = starting_stack - big_blind;
-        next.stacks[1] = starting_stack - small_blind;
-        next.pips[0] = big_blind;
-        next.pips[1] = small_blind;
+        next.pot = table->small_blind + table->big_blind;
+        next.stacks[0] = table->starting_stack - table->big_blind;
+        next.stacks[1] = table->starting_stack - table->small_blind;
+        next.pips[0] = table->big_blind;
+        next.pips[1] = table->small_blind;
     }
 
     if (stage == 2) next.active_player = 0;
@@ -0,0 +1,97 @@
+#include "telemetry.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+ThreadStats& ThreadStats::operator+=(const ThreadStats& other){
+    iters += other.iters;
+    for (size_t st = 0; st < nodes.size(); ++st) nodes[st] += other.nodes[st];
+    terminal_evals += other.terminal_evals;
+    deal_seconds += other.deal_seconds;
+    traverse_seconds += other.traverse_seconds;
+    wait_seconds += other.wait_seconds;
+    return *this;
+}
+
+Telemetry::Telemetry(const TelemetryParams& params, size_t num_threads):
+    params(params), start(steady::now()), window_start(start), window(num_threads){
+
+    if (params.interval_seconds > 0.0 && !params.path.empty()){
+        if (params.path.has_parent_path()) std::filesystem::create_directories(params.path.parent_path());
+        out.open(params.path, std::ios::app);
+        if (!out) throw std::runtime_error("cannot open " + params.path.string());
+    }
+}
+
+void Telemetry::record_batch(std::vector<ThreadStats>& batch, double batch_seconds, double discount_seconds, int cur_iter){
+
+    for (size_t t = 0; t < batch.size(); ++t){
+        batch[t].wait_seconds = std::max(0.0, batch_seconds - batch[t].deal_seconds - batch[t].traverse_seconds);
+    }
+
+    if (params.interval_seconds <= 0.0) return;
+
+    for (size_t t = 0; t < batch.size(); ++t) window[t] += batch[t];
+    window_discount_seconds += discount_seconds;
+    ++window_batches;
+
+    if (std::chrono::duration<double>(steady::now() - window_start).count() >= params.interval_seconds) emit(cur_iter);
+}
+
+void Telemetry::flush(int cur_iter){
+    if (params.interval_seconds > 0.0 && window_batches > 0) emit(cur_iter);
+}
+
+void Telemetry::emit(int cur_iter){
+    steady::time_point now = steady::now();
+    double seconds = std::chrono::duration<double>(now - window_start).count();
+    double elapsed = std::chrono::duration<double>(now - start).count();
+
+    ThreadStats total;
+    uint64_t min_iters = UINT64_MAX, max_iters = 0;
+    for (const ThreadStats& t : window){
+        total += t;
+        min_iters = std::min(min_iters, t.iters);
+        max_iters = std::max(max_iters, t.iters);
+    }
+
+    double iters_per_sec = static_cast<double>(total.iters) / seconds;
+    double nodes_per_sec = static_cast<double>(total.total_nodes()) / seconds;
+    double thread_seconds = seconds * static_cast<double>(window.size());
+
+    std::ostringstream line;
+    line << std::setprecision(6);
+    if (out.is_open()){
+        line << "{\"elapsed_s\": " << elapsed << ", \"iter\": " << cur_iter << ", \"window_s\": " << seconds
+            << ", \"iters_per_sec\": " << iters_per_sec << ", \"nodes_per_sec\": " << nodes_per_sec
+            << ", \"nodes_by_street\": [" << total.nodes[0] << ", " << total.nodes[1] << ", " << total.nodes[2]
+            << ", " << total.nodes[3] << "], \"terminal_evals\": " << total.terminal_evals
+            << ", \"discount_s\": " << window_discount_seconds << ", \"threads\": [";
+        for (size_t t = 0; t < window.size(); ++t){
+            line << (t ? ", " : "") << "{\"iters\": " << window[t].iters << ", \"deal_s\": " << window[t].deal_seconds
+                << ", \"traverse_s\": " << window[t].traverse_seconds << ", \"wait_s\": " << window[t].wait_seconds << "}";
+        }
+        line << "]}\n";
+        out << line.str() << std::flush;
+    }
+    else {
+        // shares of the thread time in the window, plus the fraction of the wall clock spent discounting
+        line << std::fixed << std::setprecision(1) << "[telemetry] " << elapsed << "s iter " << cur_iter
+            << " | " << iters_per_sec << " it/s | " << nodes_per_sec / 1e6 << "M nodes/s | deal "
+            << 100.0 * total.deal_seconds / thread_seconds << "% traverse "
+            << 100.0 * total.traverse_seconds / thread_seconds << "% wait "
+            << 100.0 * total.wait_seconds / thread_seconds << "% discount "
+            << 100.0 * window_discount_seconds / seconds << "% | thread iters min/max "
+            << std::setprecision(2) << (max_iters ? static_cast<double>(min_iters) / static_cast<double>(max_iters) : 1.0);
+        std::cout << line.str() << std::endl;
+    }
+
+    std::fill(window.begin(), window.end(), ThreadStats{});
+    window_discount_seconds = 0.0;
+    window_batches = 0;
+    window_start = now;
+}
@@ -12,6 +12,8 @@
 #include "info_sets.h"
 #include "action_tree.h"
 #include "training.h"
+#include "visit_report.h"
+#include "perf_counters.h"
 
 namespace fs = std::filesystem;
 
@@ -24,7 +26,7 @@ void write_preflop_csv(const std::string& path, const CFR& cfr) {
 
     const ActionTree& at = cfr.get_action_tree();
     const InfoSets& isets = cfr.get_infosets();
-    const size_t root_idx = at.root_idx;
+    const NodeIdx root_idx = at.root_idx;
     const std::vector<Action>& actions = at.pub_states[root_idx].edge_labels;
 
     std::ofstream out(path);
@@ -39,7 +41,7 @@ void write_preflop_csv(const std::string& path, const CFR& cfr) {
     std::vector<double> strat;
     auto record = [&](const std::string& name, uint8_t c0, uint8_t c1) {
         uint8_t cards[2] = {c0, c1};
-        InfoKey key{root_idx, hand_index_last(&idx.h, cards), actions.size()};
+        InfoKey key{root_idx, static_cast<ClusterIdx>(hand_index_last(&idx.h, cards)), static_cast<ActionCount>(actions.size())};
         isets.get_strategy(key, strat);
         out << name;
         for (double p : strat) out << ',' << p;
@@ -62,29 +64,57 @@ void write_preflop_csv(const std::string& path, const CFR& cfr) {
     if (!out) throw std::runtime_error("write failed: " + path);
 }
 
+void print_page_report(std::ostream& out, const CFR& cfr) {
+    const InfoSets& isets = cfr.get_infosets();
+    const CardBuckets& buckets = cfr.get_card_buckets();
+    out << "pages (huge_pages = " << huge_pages::to_string(huge_pages::get_mode()) << ")\n"
+        << "  regret_sum      " << huge_pages::describe(isets.regret_sum.data()) << '\n'
+        << "  strategy_sum    " << huge_pages::describe(isets.strategy_sum.data()) << '\n'
+        << "  flop buckets    " << huge_pages::describe(buckets.flop_clusters.data()) << '\n'
+        << "  turn buckets    " << huge_pages::describe(buckets.turn_clusters.data()) << '\n'
+        << "  river buckets   " << huge_pages::describe(buckets.river_clusters.data()) << '\n';
+}
+
 void generate_report(const ReportParams& report, const CFR& cfr) {
     std::vector<fs::path> targets;
 
     if (report.preflop_path) targets.push_back(*report.preflop_path);
+    if (report.visit_report_path) targets.push_back(*report.visit_report_path);
 
     if (report.isets_paths){
         const auto& ip = *report.isets_paths;
         targets.insert(targets.end(), {ip.regret_path, ip.strategy_path, ip.offset_path, ip.iters_path});
+        if (!ip.visits_path.empty()) targets.push_back(ip.visits_path);
     }
 
     for (const fs::path& p : targets)
         if (p.has_parent_path()) fs::create_directories(p.parent_path());
 
+    // the checkpoint first, so a failing report never costs the training
+    if (report.isets_paths){
+        PERF_REGION("checkpoint");
+        cfr.get_infosets().write_ckpt(*report.isets_paths);
+    }
+
     if (report.preflop_path)
         write_preflop_csv(*report.preflop_path, cfr);
 
-    if (report.isets_paths)
-        cfr.get_infosets().write_ckpt(*report.isets_paths);
+    if (report.visit_report_path)
+        write_visit_report(report.visit_report_path->string(), cfr);
+}
+
+void check_configs(const CFRSpec& spec, const TrainParams& train, const ReportParams& report) {
+    bool loads_visits = spec.isets_paths && !spec.isets_paths->visits_path.empty()
+        && fs::exists(spec.isets_paths->visits_path);
+    if (report.visit_report_path && train.visit_sample_every == 0 && !loads_visits)
+        throw std::runtime_error("save_visit_report needs visit counts: set [visits] sample_every > 0 in train.toml"
+            " or load a visits file with the checkpoint");
 }
 
 CFR load_spec(CFRSpec spec) {
     CardBuckets buckets{spec.bucket_paths};
-    PokerState init_state{spec.starting_stack, spec.big_blind, spec.small_blind}; 
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
     ActionTree action_tree{init_state, spec.bet_sizes};
 
     if (spec.isets_paths) {
@@ -130,6 +160,8 @@ CFRSpec load_cfr_config(const std::filesystem::path& cfr_toml_path, const std::f
             .offset_path = (root/toml["load_isets"]["offset"].value<std::string>().value()).string(),
             .iters_path = (root/toml["load_isets"]["iters"].value<std::string>().value()).string()
         };
+        std::string visits = toml["load_isets"]["visits"].value_or(std::string{});
+        if (!visits.empty()) spec.isets_paths->visits_path = (root/visits).string();
     }
 
     return spec;
@@ -148,6 +180,8 @@ ReportParams load_report_config(const std::filesystem::path& report_toml_path, c
             .offset_path = (root/toml["save_isets"]["offset"].value<std::string>().value()).string(),
             .iters_path = (root/toml["save_isets"]["iters"].value<std::string>().value()).string()
         };
+        std::string visits = toml["save_isets"]["visits"].value_or(std::string{});
+        if (!visits.empty()) report.isets_paths->visits_path = (root/visits).string();
     }
     report.overwrite_isets = toml["save_isets"]["overwrite"].value_or(false);
 
@@ -155,10 +189,14 @@ ReportParams load_report_config(const std::filesystem::path& report_toml_path, c
         report.preflop_path = root / toml["save_preflop"]["path"].value<std::string>().value();
     }
     report.overwrite_preflop = toml["save_preflop"]["overwrite"].value_or(false);
+
+    if (toml["save_visit_report"]["enabled"].value_or(false)) {
+        report.visit_report_path = root / toml["save_visit_report"]["path"].value<std::string>().value();
+    }
     return report;
 }
 
-TrainParams load_train_config(const std::filesystem::path& run_toml_path) {
+TrainParams load_train_config(const std::filesystem::path& run_toml_path, const std::filesystem::path& root) {
     toml::table toml = toml::parse_file(run_toml_path.string());
     TrainParams train;
 
@@ -167,6 +205,19 @@ TrainParams load_train_config(const std::filesystem::path& run_toml_path) {
     train.num_threads = toml["train"]["num_threads"].value<size_t>().value();
     train.omp_chunk_sz = toml["train"]["omp_chunk_sz"].value<size_t>().value();
     train.base_seed= toml["train"]["base_seed"].value<uint32_t>().value();
+    train.scheduler.scheduler = parse_scheduler(toml["train"]["scheduler"].value_or(std::string{"for"}));
+    train.scheduler.task_depth = toml["train"]["task_depth"].value_or(size_t{2});
+
+    train.visit_sample_every = toml["visits"]["sample_every"].value_or(size_t{0});
+
+    train.telemetry.interval_seconds = toml["telemetry"]["interval_seconds"].value_or(0.0);
+    std::string telemetry_path = toml["telemetry"]["path"].value_or(std::string{});
+    if (!telemetry_path.empty()) train.telemetry.path = root / telemetry_path;
+
+    train.numa.affinity = numa::parse_affinity(toml["numa"]["affinity"].value_or(std::string{"none"}));
+    train.numa.placement = numa::parse_placement(toml["numa"]["placement"].value_or(std::string{"first_touch"}));
+
+    train.huge_pages = huge_pages::parse_mode(toml["memory"]["huge_pages"].value_or(std::string{"off"}));
 
     return train;
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "tuner.h"
+#include "action_tree.h"
+#include "card_buckets.h"
+#include "cfr.h"
+#include "poker_state.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <omp.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using steady = std::chrono::steady_clock;
+
+    double seconds_since(steady::time_point t){ return std::chrono::duration<double>(steady::now() - t).count(); }
+
+    struct Trial{
+        size_t num_threads;
+        size_t omp_chunk_sz;
+        size_t iters_per_discount;
+        double iters_per_sec = 0.0;
+
+        bool same_params(const Trial& other) const {
+            return num_threads == other.num_threads && omp_chunk_sz == other.omp_chunk_sz
+                && iters_per_discount == other.iters_per_discount;
+        }
+    };
+
+    const std::vector<size_t> chunk_candidates = {16, 32, 64, 128, 256, 512, 1024};
+    const std::vector<size_t> discount_candidates = {1'000, 2'500, 5'000, 10'000, 25'000, 50'000, 100'000};
+
+    /// @brief max_threads, then halving down to 1
+    std::vector<size_t> thread_candidates(size_t max_threads){
+        std::vector<size_t> out;
+        for (size_t t = max_threads; t > 0; t /= 2) out.push_back(t);
+        if (out.back() != 1) out.push_back(1);
+        return out;
+    }
+
+    std::string trim(const std::string& s){
+        size_t first = s.find_first_not_of(" \t");
+        if (first == std::string::npos) return "";
+        return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+    }
+
+    /// @brief Copies in_toml to out_toml with the [train] values of best, keeping every other line and the comments.
+    void write_tuned_toml(const std::filesystem::path& in_toml, const std::filesystem::path& out_toml,
+        const Trial& best, const std::string& header){
+
+        std::ifstream in(in_toml);
+        if (!in) throw std::runtime_error("cannot open " + in_toml.string());
+
+        const std::array<std::pair<std::string, size_t>, 3> tuned = {{
+            {"num_threads", best.num_threads},
+            {"omp_chunk_sz", best.omp_chunk_sz},
+            {"iters_per_discount", best.iters_per_discount},
+        }};
+
+        std::ostringstream out;
+        out << header << '\n';
+        std::string line, section;
+        size_t replaced = 0;
+        while (std::getline(in, line)){
+            std::string code = trim(line.substr(0, line.find('#')));
+            if (code.starts_with('[')) section = code;
+
+            size_t eq = code.find('=');
+            if (section == "[train]" && eq != std::string::npos){
+                std::string key = trim(code.substr(0, eq));
+                auto it = std::ranges::find(tuned, key, &std::pair<std::string, size_t>::first);
+                if (it != tuned.end()){
+                    size_t hash = line.find('#');
+                    line = key + " = " + std::to_string(it->second) + (hash == std::string::npos ? "" : " " + line.substr(hash));
+                    ++replaced;
+                }
+            }
+            out << line << '\n';
+        }
+        if (replaced != tuned.size()) throw std::runtime_error("missing [train] keys in " + in_toml.string());
+
+        std::ofstream file(out_toml);
+        if (!file) throw std::runtime_error("cannot open " + out_toml.string());
+        file << out.str();
+        if (!file) throw std::runtime_error("write failed: " + out_toml.string());
+    }
+}
+
+void run_tuner(const CFRSpec& spec, const TrainParams& train, double budget_seconds,
+    const std::filesystem::path& in_toml, const std::filesystem::path& out_toml){
+
+    steady::time_point start = steady::now();
+    const size_t max_threads = static_cast<size_t>(omp_get_num_procs());
+
+    Table table{spec.starting_stack, spec.big_blind, spec.small_blind};
+    PokerState init_state{table};
+    CFR cfr{CardBuckets{spec.bucket_paths}, ActionTree{init_state, spec.bet_sizes}};
+    cfr.set_numa(train.numa);
+    cfr.set_scheduler(train.scheduler);
+
+    // warm up on every thread, doubling the length until it takes a second. This faults in the infoset pages
+    // and gives the rate the length of the trials is set from.
+    size_t warm_iters = 1'000;
+    double warm_seconds = 0.0;
+    while (true){
+        steady::time_point warm_start = steady::now();
+        cfr.train(warm_iters, warm_iters, max_threads, train.omp_chunk_sz, train.base_seed);
+        warm_seconds = seconds_since(warm_start);
+        if (warm_seconds >= std::min(1.0, 0.05 * budget_seconds)) break;
+        warm_iters *= 2;
+    }
+    const double warm_rate = static_cast<double>(warm_iters) / warm_seconds;
+
+    std::vector<size_t> threads = thread_candidates(max_threads);
+    size_t pending = threads.size() + chunk_candidates.size() + discount_candidates.size();
+    double trial_seconds = std::max(0.0, budget_seconds - seconds_since(start)) / static_cast<double>(pending);
+    const size_t trial_iters = std::max<size_t>(1'000, static_cast<size_t>(warm_rate * trial_seconds) / 1'000 * 1'000);
+
+    std::cout << "tuning on " << max_threads << " hardware threads, " << trial_iters << " iterations per trial (seed "
+        << train.base_seed << ", budget " << budget_seconds << "s)\n\n";
+    std::cout << std::setw(10) << "threads" << std::setw(10) << "chunk" << std::setw(12) << "discount"
+        << std::setw(16) << "iterations/s" << '\n';
+
+    std::vector<Trial> trials;
+    Trial best{std::min(train.num_threads, max_threads), train.omp_chunk_sz,
+        std::min(train.iters_per_discount, trial_iters)};
+
+    // estimates the time from the warm up rate scaled linearly by threads, and keeps time for the pending trials
+    auto run_trial = [&](Trial trial){
+        --pending;
+        if (std::ranges::any_of(trials, [&](const Trial& t){ return t.same_params(trial); })) return;
+
+        double expected = static_cast<double>(trial_iters) / (warm_rate * static_cast<double>(trial.num_threads)
+            / static_cast<double>(max_threads));
+        double left = budget_seconds - seconds_since(start) - static_cast<double>(pending) * trial_seconds;
+        std::cout << std::setw(10) << trial.num_threads << std::setw(10) << trial.omp_chunk_sz
+            << std::setw(12) << trial.iters_per_discount;
+        if (expected > left){
+            std::cout << std::setw(16) << "skipped" << '\n';
+            return;
+        }
+
+        cfr.reset();
+        steady::time_point trial_start = steady::now();
+        cfr.train(trial_iters, trial.iters_per_discount, trial.num_threads, trial.omp_chunk_sz, train.base_seed);
+        trial.iters_per_sec = static_cast<double>(trial_iters) / seconds_since(trial_start);
+        std::cout << std::setw(16) << static_cast<uint64_t>(trial.iters_per_sec) << std::endl;
+
+        trials.push_back(trial);
+        if (trial.iters_per_sec > best.iters_per_sec) best = trial;
+    };
+
+    for (size_t t : threads) run_trial({t, best.omp_chunk_sz, best.iters_per_discount});
+    for (size_t c : chunk_candidates) run_trial({best.num_threads, c, best.iters_per_discount});
+    for (size_t d : discount_candidates){
+        // a discount cadence longer than the trial is never measured
+        if (d > trial_iters) { --pending; continue; }
+        run_trial({best.num_threads, best.omp_chunk_sz, d});
+    }
+
+    if (trials.empty()) throw std::runtime_error("no trial fit in the tuning budget, raise it");
+
+    std::ostringstream header;
+    header << "# written by `train tune` from " << in_toml.filename().string() << ": "
+        << static_cast<uint64_t>(best.iters_per_sec) << " iterations/s on " << max_threads << " hardware threads";
+    write_tuned_toml(in_toml, out_toml, best, header.str());
+
+    std::cout << "\nfastest: num_threads = " << best.num_threads << ", omp_chunk_sz = " << best.omp_chunk_sz
+        << ", iters_per_discount = " << best.iters_per_discount << " (" << static_cast<uint64_t>(best.iters_per_sec)
+        << " iterations/s) after " << std::fixed << std::setprecision(1) << seconds_since(start) << "s\n";
+    std::cout << "iters_per_discount also sets how often the regrets are discounted, so check it against convergence\n";
+    std::cout << "wrote " << out_toml.string() << '\n';
+}
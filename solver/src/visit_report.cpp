@@ -0,0 +1,180 @@
+#include "visit_report.h"
+#include "action_tree.h"
+#include "info_sets.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    const std::array<std::string, 4> street_names = {"preflop", "flop", "turn", "river"};
+
+    struct Tally{
+        size_t nodes = 0;
+        size_t rows = 0;
+        size_t visited_rows = 0;
+        uint64_t visits = 0;
+        uint64_t bytes = 0; // regret and strategy memory of the rows
+
+        void add(const Tally& node){
+            nodes += node.nodes;
+            rows += node.rows;
+            visited_rows += node.visited_rows;
+            visits += node.visits;
+            bytes += node.bytes;
+        }
+    };
+
+    std::string percent(double num, double den){
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2) << (den > 0 ? 100.0 * num / den : 0.0) << '%';
+        return out.str();
+    }
+
+    /// @brief the action on edge edge_idx out of node, with raises named by their bet size
+    std::string action_label(const ActionTree& at, size_t node, size_t edge_idx){
+        const PublicState& ps = at.pub_states[node];
+        const Action& action = ps.edge_labels[edge_idx];
+        int bet_idx = ps.edge_bet_idxs[edge_idx];
+        if (action.type != 3 || bet_idx < 0) return action.to_string();
+
+        std::ostringstream out;
+        out << at.bet_sizes[ps.street_idx][bet_idx] << " pot";
+        return out.str();
+    }
+
+    /// @brief index of child among the children of its parent
+    size_t edge_into(const ActionTree& at, size_t child){
+        const std::vector<NodeIdx>& siblings = at.nodes[at.nodes[child].parent_idx].child_idxs;
+        return static_cast<size_t>(std::ranges::find(siblings, child) - siblings.begin());
+    }
+
+    std::string path_to(const ActionTree& at, size_t node){
+        std::vector<std::string> steps;
+        for (size_t v = node; !at.is_root_node(v); v = at.nodes[v].parent_idx){
+            size_t parent = at.nodes[v].parent_idx;
+            steps.push_back(street_names[at.street(parent)] + " " + action_label(at, parent, edge_into(at, v)));
+        }
+        if (steps.empty()) return "root";
+
+        std::string out;
+        for (auto it = steps.rbegin(); it != steps.rend(); ++it) out += (out.empty() ? "" : " > ") + *it;
+        return out;
+    }
+
+    void write_table(std::ostream& out, const std::string& title, const std::vector<std::pair<std::string, Tally>>& rows,
+        const Tally& total){
+
+        out << '\n' << title << '\n';
+        out << std::left << std::setw(28) << "" << std::right << std::setw(10) << "nodes" << std::setw(14) << "rows"
+            << std::setw(14) << "visited rows" << std::setw(12) << "visits" << std::setw(12) << "memory" << '\n';
+        for (const auto& [label, t] : rows){
+            out << std::left << std::setw(28) << label << std::right << std::setw(10) << t.nodes << std::setw(14) << t.rows
+                << std::setw(14) << percent(t.visited_rows, t.rows)
+                << std::setw(12) << percent(t.visits, total.visits)
+                << std::setw(12) << percent(t.bytes, total.bytes) << '\n';
+        }
+    }
+}
+
+void write_visit_report(const std::string& path, const CFR& cfr, size_t max_listed){
+
+    const ActionTree& at = cfr.get_action_tree();
+    const InfoSets& isets = cfr.get_infosets();
+    if (isets.visits.empty() || isets.row_offsets.size() != at.nodes.size())
+        throw std::runtime_error("no visit counts to report, train with [visits] sample_every > 0 or load them with the isets");
+
+    // per decision node tallies, and depth = depth of parent + 1 (parents are created before their children)
+    std::vector<Tally> node_tally(at.nodes.size());
+    std::vector<size_t> depth(at.nodes.size(), 0);
+    Tally total;
+
+    for (size_t node = 0; node < at.nodes.size(); ++node){
+        if (!at.is_root_node(node)) depth[node] = depth[at.nodes[node].parent_idx] + 1;
+        if (at.is_terminal(node)) continue;
+
+        size_t first = isets.row_offsets[node];
+        size_t last = node + 1 < at.nodes.size() ? isets.row_offsets[node + 1] : isets.visits.size();
+
+        Tally& t = node_tally[node];
+        t.nodes = 1;
+        t.rows = last - first;
+        for (size_t row = first; row < last; ++row){
+            t.visits += isets.visits[row];
+            t.visited_rows += isets.visits[row] > 0;
+        }
+        t.bytes = t.rows * static_cast<uint64_t>(at.num_children(node)) * 2 * sizeof(double);
+        total.add(t);
+    }
+
+    std::vector<Tally> by_street(street_names.size());
+    std::map<size_t, Tally> by_depth;
+    std::map<std::pair<int, std::string>, Tally> by_action;
+    Tally dead;
+
+    for (size_t node = 0; node < at.nodes.size(); ++node){
+        if (at.is_terminal(node)) continue;
+        const Tally& t = node_tally[node];
+
+        by_street[at.street(node)].add(t);
+        by_depth[depth[node]].add(t);
+        if (!at.is_root_node(node)){
+            size_t parent = at.nodes[node].parent_idx;
+            by_action[{at.street(parent), action_label(at, parent, edge_into(at, node))}].add(t);
+        }
+        if (t.visits == 0) dead.add(t);
+    }
+
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("cannot open " + path);
+
+    out << "infoset visit report at iteration " << isets.cur_iter << " (visits are sampled)\n";
+    out << total.rows << " rows in " << total.nodes << " decision nodes, " << total.bytes / (1 << 20) << " MB of regrets and strategy\n";
+    out << percent(total.visited_rows, total.rows) << " of the rows were visited, " << total.visits << " sampled visits\n";
+    out << dead.nodes << " decision nodes were never visited, holding " << percent(dead.bytes, total.bytes) << " of the memory\n";
+
+    std::vector<std::pair<std::string, Tally>> rows;
+    for (size_t st = 0; st < by_street.size(); ++st) rows.push_back({street_names[st], by_street[st]});
+    write_table(out, "by street", rows, total);
+
+    rows.clear();
+    for (const auto& [d, t] : by_depth) rows.push_back({"depth " + std::to_string(d), t});
+    write_table(out, "by node depth", rows, total);
+
+    rows.clear();
+    for (const auto& [key, t] : by_action) rows.push_back({street_names[key.first] + " " + key.second, t});
+    write_table(out, "by action into the node (raises by bet size, see configs/cfr.toml)", rows, total);
+
+    // least visited first, bigger nodes first among equals
+    std::vector<size_t> decision_nodes;
+    for (size_t node = 0; node < at.nodes.size(); ++node)
+        if (!at.is_terminal(node)) decision_nodes.push_back(node);
+
+    auto visits_per_row = [&](size_t node){
+        return static_cast<double>(node_tally[node].visits) / static_cast<double>(std::max<size_t>(1, node_tally[node].rows));
+    };
+    std::ranges::sort(decision_nodes, [&](size_t a, size_t b){
+        if (visits_per_row(a) != visits_per_row(b)) return visits_per_row(a) < visits_per_row(b);
+        return node_tally[a].bytes > node_tally[b].bytes;
+    });
+    decision_nodes.resize(std::min(decision_nodes.size(), max_listed));
+
+    out << "\nleast visited nodes\n";
+    out << std::setw(14) << "visits/row" << std::setw(14) << "visited rows" << std::setw(12) << "memory" << "  path\n";
+    for (size_t node : decision_nodes){
+        const Tally& t = node_tally[node];
+        out << std::fixed << std::setprecision(3) << std::setw(14) << visits_per_row(node)
+            << std::setw(14) << percent(t.visited_rows, t.rows) << std::setw(12) << percent(t.bytes, total.bytes)
+            << "  " << path_to(at, node) << '\n';
+    }
+
+    if (!out) throw std::runtime_error("write failed: " + path);
+}
@@ -0,0 +1,31 @@
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include "training.h"
+#include "visit_report.h"
+
+namespace fs = std::filesystem;
+
+// usage: visit_report <output path>
+// Writes the visit report of the checkpoint in the [load_isets] section of configs/cfr.toml, which needs a visits file.
+int main(int argc, char** argv) {
+    try {
+        if (argc != 2) throw std::runtime_error("usage: visit_report <output path>");
+
+        fs::path exe  = fs::weakly_canonical(fs::path(argv[0]));
+        fs::path root = exe.parent_path().parent_path();
+
+        CFRSpec spec = load_cfr_config(root / "configs/cfr.toml", root);
+        if (!spec.isets_paths || spec.isets_paths->visits_path.empty())
+            throw std::runtime_error("enable [load_isets] in configs/cfr.toml and set its visits path");
+
+        CFR cfr = load_spec(std::move(spec));
+        write_visit_report(argv[1], cfr);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}